@@ -0,0 +1,183 @@
+// BSP.c
+// Runs on Linux, host port of the kernel
+// Board support package for the host: the three periodic timers run
+// from the host tick, BSP_Delay1ms spins like the board does, and the
+// MKII sensors give fixed readings.  Only the functions used by the
+// kernel, Lab3.c and WorldShapers.c are here.  With HOST_SIM, the
+// delay and the LCD take virtual time instead (see Host_Busy).
+
+#include <stdint.h>
+#include <time.h>
+#include "Host.h"
+#define HOST_REGISTER(name) volatile uint32_t name;
+#include "inc/tm4c123gh6pm.h"
+#include "inc/BSP.h"
+#include "inc/Profile.h"
+#include "inc/Texas.h"
+
+volatile uint32_t Host_Gpio[6][0x540/4];
+
+uint32_t static LoopsPerMs = 1;  // BSP_Delay1ms loops, measured by BSP_Clock_InitFastest
+#define PIXELCYCLES 160          // bus cycles to send one pixel to the LCD, 16 bits over SSI
+
+void static Spin(uint32_t loops){
+  volatile uint32_t i;
+  for(i=0; i<loops; i++){
+  }
+}
+
+// ------------BSP_Clock_InitFastest------------
+// The host clock can't be changed; this measures the speed of
+// BSP_Delay1ms instead, called with interrupts disabled by OS_Init
+// Input: none
+// Output: none
+void BSP_Clock_InitFastest(void){
+  struct timespec start,end;
+  uint32_t ns;
+  SYSCTL_PRGPIO_R = 0xFFFFFFFF;   // all ports ready
+  SYSCTL_PRTIMER_R = 0xFFFFFFFF;  // all timers ready
+  GPIO_PORTD_DATA_R |= 0xC0;      // buttons 1 and 2 released
+  if(HOST_SIM || (LoopsPerMs > 1)){
+    return;                       // measured already
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  Spin(10000000);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  ns = (end.tv_sec-start.tv_sec)*1000000000 + (end.tv_nsec-start.tv_nsec);
+  LoopsPerMs = (uint32_t)(10000000ULL*1000000/ns);
+}
+
+uint32_t BSP_Clock_GetFreq(void){
+  return HOST_BUSFREQ;
+}
+
+// ------------BSP_Delay1ms------------
+// Simple delay function which delays about n milliseconds.
+// Like the board this counts loops, so it takes longer when
+// other threads share the processor.
+// Inputs: n, number of msec to wait
+// Outputs: none
+void BSP_Delay1ms(uint32_t n){
+  while(n){
+#if HOST_SIM
+    Host_Busy(HOST_BUSFREQ/1000);
+#else
+    Spin(LoopsPerMs);
+#endif
+    n--;
+  }
+}
+
+void BSP_PeriodicTask_Init(void(*task)(void), uint32_t freq, uint8_t priority){
+  Host_Periodic(0, task, freq, priority);
+}
+void BSP_PeriodicTask_Stop(void){
+  Host_Periodic(0, 0, 1, 0);
+}
+void BSP_PeriodicTask_InitB(void(*task)(void), uint32_t freq, uint8_t priority){
+  Host_Periodic(1, task, freq, priority);
+}
+void BSP_PeriodicTask_StopB(void){
+  Host_Periodic(1, 0, 1, 0);
+}
+void BSP_PeriodicTask_InitC(void(*task)(void), uint32_t freq, uint8_t priority){
+  Host_Periodic(2, task, freq, priority);
+}
+void BSP_PeriodicTask_StopC(void){
+  Host_Periodic(2, 0, 1, 0);
+}
+
+// buttons are not pressed, Host_Button1 only makes the PD6 edge interrupt
+void BSP_Button1_Init(void){}
+uint8_t BSP_Button1_Input(void){ return 1; }
+void BSP_Button2_Init(void){}
+uint8_t BSP_Button2_Input(void){ return 1; }
+uint16_t static JoystickX = 512, JoystickY = 512; // centered
+uint8_t static JoystickSelect = 1;                // not pressed
+void Host_Joystick(uint16_t x, uint16_t y, uint8_t select){
+  JoystickX = x; JoystickY = y; JoystickSelect = select;
+}
+void BSP_Joystick_Init(void){}
+void BSP_Joystick_Input(uint16_t *x, uint16_t *y, uint8_t *select){
+  *x = JoystickX; *y = JoystickY; *select = JoystickSelect;
+}
+void BSP_RGB_Init(uint16_t red, uint16_t green, uint16_t blue){}
+void BSP_RGB_Set(uint16_t red, uint16_t green, uint16_t blue){}
+void BSP_Buzzer_Init(uint16_t duty){}
+void BSP_Buzzer_Set(uint16_t duty){}
+
+// sensors read the same values every time
+void BSP_Accelerometer_Init(void){}
+void BSP_Accelerometer_Input(uint16_t *x, uint16_t *y, uint16_t *z){
+  *x = 512; *y = 512; *z = 700;     // flat on the table
+}
+void BSP_Microphone_Init(void){}
+// a quiet square wave; a constant reading makes sqrt32 in Lab3.c
+// divide by zero, which gives 0 on the board but traps on the host
+void BSP_Microphone_Input(uint16_t *mic){
+  static uint16_t sound = 500;
+  sound = 1024 - sound;             // 500, 524, 500, ...
+  *mic = sound;
+}
+void BSP_LightSensor_Init(void){}
+void BSP_LightSensor_Start(void){}
+int BSP_LightSensor_End(uint32_t *light){
+  *light = 10000;                   // 100 lux
+  return 1;
+}
+void BSP_TempSensor_Init(void){}
+void BSP_TempSensor_Start(void){}
+int BSP_TempSensor_End(int32_t *sensorV, int32_t *localT){
+  *sensorV = 0;
+  *localT = 250000;                 // 25 C
+  return 1;
+}
+
+// there is no LCD, drawing only takes the time to send the pixels
+void BSP_LCD_Init(void){}
+void BSP_LCD_FillScreen(uint16_t color){
+  Host_Busy(128*128*PIXELCYCLES);
+}
+void BSP_LCD_DrawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color){
+  if(h > 0){
+    Host_Busy(h*PIXELCYCLES);
+  }
+}
+void BSP_LCD_DrawBitmap(int16_t x, int16_t y, const uint16_t *image, int16_t w, int16_t h){
+  if((w > 0) && (h > 0)){
+    Host_Busy(w*h*PIXELCYCLES);
+  }
+}
+void BSP_LCD_DrawChar(int16_t x, int16_t y, char c, int16_t textColor, int16_t bgColor, uint8_t size){
+  Host_Busy(6*8*size*size*PIXELCYCLES);   // 5x7 font in a 6x8 cell
+}
+uint32_t BSP_LCD_DrawString(uint16_t x, uint16_t y, char *pt, int16_t textColor){ return 0; }
+void BSP_LCD_SetCursor(uint32_t newX, uint32_t newY){}
+void BSP_LCD_OutUDec4(uint32_t n, int16_t textColor){}
+void BSP_LCD_OutUFix2_1(uint32_t n, int16_t textColor){}
+void BSP_LCD_Drawaxes(uint16_t axisColor, uint16_t bgColor, char *xLabel,
+  char *yLabel1, uint16_t label1Color, char *yLabel2, uint16_t label2Color,
+  int32_t ymax, int32_t ymin){}
+void BSP_LCD_PlotPoint(int32_t data1, uint16_t color1){}
+void BSP_LCD_PlotIncrement(void){}
+uint16_t BSP_LCD_Color565(uint8_t r, uint8_t g, uint8_t b){
+  return ((r&0xF8)<<8)|((g&0xFC)<<3)|(b>>3);
+}
+
+// no profiling pins and no grader
+void Profile_Init(void){}
+void Profile_Toggle0(void){}
+void Profile_Toggle1(void){}
+void Profile_Toggle2(void){}
+void Profile_Toggle3(void){}
+void Profile_Toggle4(void){}
+void Profile_Toggle5(void){}
+void Profile_Toggle6(void){}
+void TExaS_Init(enum TExaSmode mode, uint32_t edXcode){}
+void TExaS_Task0(void){}
+void TExaS_Task1(void){}
+void TExaS_Task2(void){}
+void TExaS_Task3(void){}
+void TExaS_Task4(void){}
+void TExaS_Task5(void){}
+void TExaS_Task6(void){}
@@ -0,0 +1,18 @@
+// BenchMain.c
+// Runs on Linux, host port of the kernel
+// Runs ../KernelBench, compiled with main renamed to KernelBench_main,
+// and stops when it has sent all its rows.  The cycle counts come
+// from the host clock scaled to 80 MHz.
+//   ./bench
+
+#include <stdint.h>
+#include "Host.h"
+
+int KernelBench_main(void);
+extern uint32_t BenchDone;
+
+int main(void){
+  Host_Init();
+  Host_StopWhen(&BenchDone);
+  return KernelBench_main(); // does not return
+}
@@ -0,0 +1,438 @@
+// CortexM.c
+// Runs on Linux, host port of the kernel
+// Interrupt masking, SysTick, Timer4A and the host tick.
+// The I bit is PRIMASK below; setting it also blocks SIGALRM and
+// SIGUSR1.  Any thread switch is done with the signals blocked, and
+// the thread that resumes unblocks them again when it enables
+// interrupts or returns from the signal handler it was switched in.
+// Built with HOST_SIM=1, time is a virtual clock instead: the host
+// ticks are not signals but run when the clock passes them, at the
+// points where code calls in (see Host_Busy), so a run is the same
+// every time.
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "inc/CortexM.h"
+#include "inc/tm4c123gh6pm.h"
+#include "Host.h"
+
+void SysTick_Handler(void);  // in os.c
+void PendSV_Handler(void);   // in osasm.c
+void GPIOPortD_Handler(void);// in os.c
+void TIMER4A_Handler(void) __attribute__((weak)); // in os.c with TICKLESS 1
+
+volatile uint32_t STCTRL;
+volatile uint32_t STRELOAD;
+volatile uint32_t STCURRENT;
+volatile uint32_t SYSPRI3;
+volatile uint32_t INTCTRL;
+volatile uint32_t DEMCR;
+volatile uint32_t DWT_CTRL;
+
+volatile uint32_t Host_PendSVPending;
+uint32_t static volatile Primask;  // 1 means interrupts are disabled
+uint32_t static volatile Basepri;  // nonzero masks them too, see SetBasePri
+uint32_t static volatile IsrDepth; // nonzero while a handler runs
+sigset_t static IrqSet;            // signals that are interrupts
+
+#define CYCLESPERTICK (HOST_BUSFREQ/HOST_TICKFREQ)
+// bus cycles the virtual clock advances with HOST_SIM, for code that
+// only runs between the points where it is checked
+#define SIM_CALLCYCLES   20    // each mask, unmask or DWT_CYCCNT read
+#define SIM_SWITCHCYCLES 150   // PendSV_Handler and Scheduler
+#if HOST_SIM
+uint64_t static volatile SimCycles; // virtual bus cycles since Host_Init
+uint64_t static NextTick;          // SimCycles of the next host tick
+uint64_t static WatchCycles;       // SimCycles at the last Watchdog
+#define BlockIrqs()    // no signals to block
+#define UnblockIrqs()
+#else
+#define BlockIrqs()    sigprocmask(SIG_BLOCK, &IrqSet, 0)
+#define UnblockIrqs()  sigprocmask(SIG_UNBLOCK, &IrqSet, 0)
+#endif
+
+struct periodic{
+  void(*Task)(void);   // 0 if not running
+  uint32_t Period;     // host ticks
+  uint32_t Count;      // host ticks until it runs
+  uint32_t Priority;   // 0 is highest
+};
+struct periodic static Periodic[3];
+uint32_t static Ticks;             // host ticks since Host_Init
+uint64_t static Timer4Start;       // Now() when Timer4A started counting
+uint32_t static Timer4On;          // nonzero while it counts
+#if !HOST_SIM
+struct timespec static Start;      // host clock at Host_Init
+#endif
+uint32_t static Deadline;          // stop at this tick, 0 for never
+void static (*Report)(void);
+uint32_t static volatile *StopFlag; // stop when nonzero, 0 for never
+void static (*EveryMs)(void);      // runs at the start of each msec, 0 for none
+void static Tick(void);
+
+// ******** Run ************
+// Advance the virtual clock, then run the host ticks it passed, unless
+// interrupts are disabled or masked, or a handler is running; those
+// run at the next call once they are not.  Real time does nothing
+// Inputs:  bus cycles
+// Outputs: none
+void static Run(uint32_t cycles){
+#if HOST_SIM
+  SimCycles += cycles;
+  while((SimCycles >= NextTick) && (Primask == 0) && (Basepri == 0) && (IsrDepth == 0)){
+    NextTick += CYCLESPERTICK;
+    Host_Interrupt(&Tick);
+  }
+#endif
+}
+
+// ******** Advance ************
+// Advance the virtual clock, without running the ticks it passes,
+// for code that runs with interrupts disabled or in PendSV
+// Inputs:  bus cycles
+// Outputs: none
+void static Advance(uint32_t cycles){
+#if HOST_SIM
+  SimCycles += cycles;
+#endif
+}
+
+void DisableInterrupts(void){
+  BlockIrqs();
+  Primask = 1;
+  Advance(SIM_CALLCYCLES);
+}
+
+void EnableInterrupts(void){
+  Primask = 0;
+  if(IsrDepth || Basepri){
+    return;          // rest of the handler still can't be interrupted
+  }
+  Run(SIM_CALLCYCLES);   // ticks held pending run first
+  BlockIrqs();
+  Host_PendSV();
+  UnblockIrqs();
+}
+
+long StartCritical(void){
+  long sr = Primask;
+  DisableInterrupts();
+  return sr;
+}
+
+void EndCritical(long sr){
+  if(sr == 0){
+    EnableInterrupts();
+  }
+}
+
+// ******** SetBasePri ************
+// In osasm.s on the board.  The host tick is one signal for SysTick and
+// all of the periodic tasks, so any nonzero BASEPRI masks them all, the
+// same as the I bit; interrupts above KERNELPRI are not modeled
+// Inputs:  new BASEPRI
+// Outputs: BASEPRI before
+uint32_t SetBasePri(uint32_t basepri){
+  uint32_t old = Basepri;
+  if(basepri){
+    BlockIrqs();
+    Basepri = basepri;
+    Advance(SIM_CALLCYCLES);
+    return old;
+  }
+  Basepri = 0;
+  if(Primask || IsrDepth){
+    Advance(SIM_CALLCYCLES);
+    return old;
+  }
+  Run(SIM_CALLCYCLES);
+  BlockIrqs();
+  Host_PendSV();
+  UnblockIrqs();
+  return old;
+}
+
+void WaitForInterrupt(void){
+#if HOST_SIM
+  if(IsrDepth){
+    return;          // would wake up right away
+  }
+  if(SimCycles < NextTick){
+    SimCycles = NextTick;  // sleeps until the next tick
+  }
+  Run(0);            // unless the I bit is set, then EnableInterrupts runs it
+#else
+  sigset_t none;
+  int sig;
+  if(IsrDepth){
+    return;          // would wake up right away
+  }
+  if(Primask){       // wakes, but the interrupt waits for EnableInterrupts
+    sigwait(&IrqSet, &sig);
+    raise(sig);      // pending again, it is blocked
+    return;
+  }
+  sigemptyset(&none);
+  sigsuspend(&none);
+#endif
+}
+
+// ******** ContextSwitch ************
+// Trigger PendSV to switch threads as soon as interrupts are enabled
+// Inputs: none
+// Outputs: none
+void ContextSwitch(void){
+  Host_PendSVPending = 1;
+  if((Primask == 0) && (Basepri == 0) && (IsrDepth == 0)){
+    BlockIrqs();
+    Host_PendSV();
+    UnblockIrqs();
+  }
+}
+
+void Host_PendSV(void){
+  while(Host_PendSVPending){
+    Host_PendSVPending = 0;
+    Advance(SIM_SWITCHCYCLES);
+    PendSV_Handler();
+  }
+}
+
+void Host_Interrupt(void(*handler)(void)){
+  IsrDepth++;
+  handler();
+  IsrDepth--;
+  Primask = 0;       // the interrupted code had interrupts enabled
+  if(IsrDepth == 0){
+    Host_PendSV();   // tail chain to PendSV
+  }
+}
+
+// ******** Now ************
+// Bus cycles from the virtual clock, or from the host clock
+// Inputs:  none
+// Outputs: bus cycles, 64 bits so they do not wrap
+uint64_t static Now(void){
+#if HOST_SIM
+  return SimCycles;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec*HOST_BUSFREQ + now.tv_nsec*2/25;
+#endif
+}
+
+uint32_t volatile *Host_CycleCounter(void){
+  static uint32_t volatile cycles;
+  Advance(SIM_CALLCYCLES);  // not Run, Scheduler reads it in PendSV
+  cycles = (uint32_t)Now();
+  return &cycles;
+}
+
+// ******** Timer4 ************
+// Bring Timer4A up to date: a write to ICR clears RIS, and if TAEN
+// is set it also starts the count again from TAILR, as SleepTimer_Start
+// in os.c does both; at the end of the count RIS is set and TAEN
+// cleared, one-shot.  Called with the signals blocked
+// Inputs:  none
+// Outputs: none
+void static Timer4(void){
+  uint64_t elapsed;
+  if(TIMER4_ICR_R&TIMER_ICR_TATOCINT){
+    TIMER4_ICR_R = 0;
+    Host_Timer4RIS = 0;
+    Timer4On = 0;
+  }
+  if((TIMER4_CTL_R&TIMER_CTL_TAEN) == 0){
+    Timer4On = 0;
+    return;
+  }
+  if(Timer4On == 0){
+    Timer4On = 1;
+    Timer4Start = Now();
+  }
+  elapsed = Now()-Timer4Start;
+  if(elapsed > TIMER4_TAILR_R){
+    Host_Timer4TAV = 0;
+    Host_Timer4RIS |= TIMER_RIS_TATORIS;
+    TIMER4_CTL_R &= ~TIMER_CTL_TAEN;
+    Timer4On = 0;
+  } else{
+    Host_Timer4TAV = TIMER4_TAILR_R-(uint32_t)elapsed;
+  }
+}
+
+volatile uint32_t *Host_Timer4(volatile uint32_t *reg){
+  sigset_t old;
+  sigprocmask(SIG_BLOCK, &IrqSet, &old); // empty with HOST_SIM
+  Timer4();
+  sigprocmask(SIG_SETMASK, &old, 0);
+  return reg;
+}
+
+void Host_Busy(uint32_t cycles){
+  Run(cycles);
+}
+
+void Host_EveryMs(void(*task)(void)){
+  EveryMs = task;
+}
+
+void Host_Periodic(uint32_t timer, void(*task)(void), uint32_t freq, uint32_t priority){
+  sigset_t old;
+  sigprocmask(SIG_BLOCK, &IrqSet, &old); // empty with HOST_SIM
+  if((freq == 0) || (freq > HOST_TICKFREQ)){
+    freq = HOST_TICKFREQ;
+  }
+  Periodic[timer].Period = HOST_TICKFREQ/freq;
+  Periodic[timer].Count = Periodic[timer].Period;
+  Periodic[timer].Priority = priority;
+  Periodic[timer].Task = task;
+  sigprocmask(SIG_SETMASK, &old, 0);
+}
+
+void Host_StopWhen(volatile uint32_t *flag){
+  StopFlag = flag;
+}
+
+void Host_RunFor(uint32_t time, void(*report)(void)){
+  Report = report;
+  Deadline = Ticks + time*(HOST_TICKFREQ/1000);
+}
+
+// runs every host tick, as one interrupt: the periodic tasks and
+// Timer4A that are due in priority order, then SysTick, which has the
+// lowest priority
+void static Tick(void){ uint32_t p,i;
+  Ticks++;
+  if(EveryMs && ((Ticks%(HOST_TICKFREQ/1000)) == 0)){
+    EveryMs();
+  }
+  Timer4();
+  for(p=0; p<8; p++){
+    if(TIMER4A_Handler && (Host_Timer4RIS&TIMER_RIS_TATORIS) &&
+       (TIMER4_IMR_R&TIMER_IMR_TATOIM) && (NVIC_EN2_R&0x40) &&
+       (((NVIC_PRI17_R>>21)&0x07) == p)){
+      TIMER4A_Handler();           // IRQ 70, acknowledges with ICR
+      Timer4();
+    }
+    for(i=0; i<3; i++){
+      if(Periodic[i].Task && (Periodic[i].Priority == p)){
+        Periodic[i].Count--;
+        if(Periodic[i].Count == 0){
+          Periodic[i].Count = Periodic[i].Period;
+          Periodic[i].Task();
+        }
+      }
+    }
+  }
+  if((STCTRL&0x01) && STRELOAD){
+    if(STCURRENT == 0){
+      STCURRENT = STRELOAD+1;      // written by software, reload without interrupt
+    }
+    if(STCURRENT > CYCLESPERTICK){
+      STCURRENT = STCURRENT - CYCLESPERTICK;
+    } else{
+      STCURRENT = STRELOAD+1;
+      if(STCTRL&0x02){
+        SysTick_Handler();
+      }
+    }
+  }
+  if(Deadline && (Ticks == Deadline)){
+    Report();
+    fflush(stdout);
+    _exit(0);
+  }
+  if(StopFlag && *StopFlag){
+    fflush(stdout);
+    _exit(0);
+  }
+}
+
+// button 1 pressed and released, PD6 low then high again, the falling
+// edge interrupts if armed; the rising edge is found by a debounce that
+// reads PD6 afterwards
+void Host_Button1(void){
+  GPIO_PORTD_DATA_R &= ~0x40;
+  if(GPIO_PORTD_IM_R&0x40){
+    GPIO_PORTD_RIS_R |= 0x40;
+    Host_Interrupt(&GPIOPortD_Handler);
+    GPIO_PORTD_RIS_R &= ~0x40;
+  }
+  GPIO_PORTD_DATA_R |= 0x40;
+}
+
+#if HOST_SIM
+// virtual time only stops if a thread loops without calling in,
+// like the end of WorldShapers.c; checked every second of host time
+void static Watchdog(int sig){
+  (void)sig;
+  if(SimCycles != WatchCycles){
+    WatchCycles = SimCycles;
+    return;
+  }
+  printf("stuck=%u\n", (uint32_t)(SimCycles/(HOST_BUSFREQ/1000)));
+  if(Report){
+    Report();
+  }
+  fflush(stdout);
+  _exit(0);
+}
+#else
+// SIGALRMs that arrive while one is pending are lost, so each one runs
+// the ticks the host clock says are due, and ms follow the DWT_CYCCNT
+void static AlarmSignal(int sig){ struct timespec now;
+  uint64_t due;
+  (void)sig;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  due = ((uint64_t)(now.tv_sec-Start.tv_sec)*1000000000+now.tv_nsec-Start.tv_nsec)
+       /(1000000000/HOST_TICKFREQ);
+  do{
+    Host_Interrupt(&Tick);
+  } while(Ticks < due);
+}
+
+void static EdgeSignal(int sig){
+  (void)sig;
+  Host_Button1();
+}
+#endif
+
+void Host_Init(void){
+  struct sigaction act;
+  struct itimerval period;
+  sigemptyset(&IrqSet);
+#if HOST_SIM
+  SimCycles = 0;
+  NextTick = CYCLESPERTICK;
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = &Watchdog;
+  sigaction(SIGALRM, &act, 0);
+  period.it_interval.tv_sec = 1;
+  period.it_interval.tv_usec = 0;
+  period.it_value = period.it_interval;
+  setitimer(ITIMER_REAL, &period, 0);
+#else
+  sigaddset(&IrqSet, SIGALRM);
+  sigaddset(&IrqSet, SIGUSR1);
+  memset(&act, 0, sizeof(act));
+  act.sa_mask = IrqSet;            // handlers don't nest
+  act.sa_handler = &AlarmSignal;
+  sigaction(SIGALRM, &act, 0);
+  act.sa_handler = &EdgeSignal;
+  sigaction(SIGUSR1, &act, 0);
+  period.it_interval.tv_sec = 0;
+  period.it_interval.tv_usec = 1000000/HOST_TICKFREQ;
+  period.it_value = period.it_interval;
+  clock_gettime(CLOCK_MONOTONIC, &Start);
+  setitimer(ITIMER_REAL, &period, 0);
+#endif
+}
@@ -0,0 +1,100 @@
+// Host.h
+// Runs on Linux, host port of the kernel
+// Functions of the host port that have no counterpart on the board.
+// Interrupts are signals: a SIGALRM tick every 100 us runs SysTick and
+// the BSP periodic tasks, SIGUSR1 is a falling edge on button 1 (PD6).
+// While interrupts are disabled the signals are blocked, so they are
+// held pending just like the NVIC would.
+// Built with HOST_SIM=1 there are no signals: DWT_CYCCNT is a virtual
+// clock, advanced by the calls code makes into the kernel and the BSP,
+// and the host ticks run as it passes them.  Code between those calls
+// takes no time, so a run gives the same results every time.
+
+#ifndef __HOST_H
+#define __HOST_H  1
+#include <stdint.h>
+
+#define HOST_TICKFREQ  10000     // host tick, Hz
+#define HOST_BUSFREQ   80000000  // bus clock reported by BSP_Clock_GetFreq, Hz
+#ifndef HOST_SIM
+#define HOST_SIM       0         // 1 runs on the virtual clock, see above
+#endif
+
+// ******** Host_Init ************
+// Start the host tick and the button signal, interrupts enabled
+// With HOST_SIM, start the virtual clock at 0, and a check every second
+// of host time that stops the program if the clock has not moved
+// Call once, at the start of main
+// Inputs:  none
+// Outputs: none
+void Host_Init(void);
+
+// ******** Host_RunFor ************
+// Stop the program after some time
+// Inputs:  number of msec to run
+//          function to call at the end, from the tick interrupt, or
+//          from the check of Host_Init when a HOST_SIM program is stuck
+// Outputs: none
+void Host_RunFor(uint32_t time, void(*report)(void));
+
+// ******** Host_StopWhen ************
+// Stop the program once a flag is set, checked every host tick
+// Inputs:  pointer to the flag
+// Outputs: none
+void Host_StopWhen(volatile uint32_t *flag);
+
+// ******** Host_Periodic ************
+// Run a function periodically from the host tick, for BSP.c
+// Inputs:  timer 0 to 2 (BSP_PeriodicTask_Init, InitB, InitC)
+//          pointer to a void/void function, 0 to stop
+//          frequency in Hz, 1 to HOST_TICKFREQ
+//          priority 0 (highest) to 6, lower priorities run after
+// Outputs: none
+void Host_Periodic(uint32_t timer, void(*task)(void), uint32_t freq, uint32_t priority);
+
+// ******** Host_EveryMs ************
+// Run a function at the start of each msec, inside the host tick
+// interrupt, to drive inputs or sample the program
+// Inputs:  pointer to a void/void function, 0 to stop
+// Outputs: none
+void Host_EveryMs(void(*task)(void));
+
+// ******** Host_Busy ************
+// Time the board would spend in a BSP function the host does not
+// have to do, like sending pixels to the LCD.  With HOST_SIM it
+// advances the virtual clock, and ticks it passes run if interrupts
+// are enabled; otherwise it does nothing
+// Inputs:  bus cycles
+// Outputs: none
+void Host_Busy(uint32_t cycles);
+
+// ******** Host_Button1 ************
+// Press and release button 1 (PD6), as kill -USR1 does; the falling
+// edge interrupts if it is armed.  Call from an interrupt, like a
+// function given to Host_EveryMs
+// Inputs:  none
+// Outputs: none
+void Host_Button1(void);
+
+// ******** Host_Joystick ************
+// Move the joystick, read by BSP_Joystick_Input, centered at first
+// Inputs:  x and y, 0 to 1023
+//          select, 0 if pressed
+// Outputs: none
+void Host_Joystick(uint16_t x, uint16_t y, uint8_t select);
+
+// ******** Host_Interrupt ************
+// Run an interrupt handler from a signal handler, then take a PendSV
+// it pended once the handler returns, as the processor would
+// Inputs:  pointer to the handler
+// Outputs: none
+void Host_Interrupt(void(*handler)(void));
+
+// ******** Host_PendSV ************
+// Take any pending PendSV, called with interrupts disabled and not in a handler
+// Inputs:  none
+// Outputs: none
+void Host_PendSV(void);
+
+extern volatile uint32_t Host_PendSVPending; // set by ContextSwitch
+#endif
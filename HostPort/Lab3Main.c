@@ -0,0 +1,81 @@
+// Lab3Main.c
+// Runs on Linux, host port of the kernel
+// Runs one of the Lab3.c programs for a while, then prints the
+// counters it keeps, one name=value per line.
+//   ./lab3 step [msec]
+// step is 1 to 5 for main_step1 to main_step5, or 0 for the main
+// program of Lab3.c; msec defaults to 5000.
+// Lab3.c is compiled with main renamed to Lab3_main.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Host.h"
+
+int main_step1(void);
+int main_step2(void);
+int main_step3(void);
+int main_step4(void);
+int main_step5(void);
+int Lab3_main(void);
+
+extern int32_t s1,s2;
+extern int32_t CountA,CountB,CountC,CountD,CountE,CountF;
+extern int32_t TaskGdata,TaskHLostData,CountI,CountJ,CountK,CountL;
+extern int32_t TaskMdata,TaskNLostData,CountO,CountP,CountQ,CountR;
+extern int32_t TaskSdata,TaskTLostData,CountU,CountV,CountW,CountX,CountY,CountZ;
+extern uint32_t Time,Steps,SoundRMS,LightData,LostTask1Data,Count7;
+extern int32_t TemperatureData;
+uint32_t OS_PeriodicEventPeak(void);
+
+#define OUT(x) printf("%s=%ld\n", #x, (long)(x))
+
+void static Report1(void){
+  OUT(s1); OUT(s2);
+}
+void static Report2(void){
+  OUT(CountA); OUT(CountB); OUT(CountC); OUT(CountD); OUT(CountE); OUT(CountF);
+}
+void static Report3(void){
+  OUT(TaskGdata); OUT(TaskHLostData); OUT(CountI); OUT(CountJ); OUT(CountK); OUT(CountL);
+}
+void static Report4(void){
+  OUT(TaskMdata); OUT(TaskNLostData); OUT(CountO); OUT(CountP); OUT(CountQ); OUT(CountR);
+}
+void static Report5(void){
+  OUT(TaskSdata); OUT(TaskTLostData); OUT(CountU); OUT(CountV);
+  OUT(CountW); OUT(CountX); OUT(CountY); OUT(CountZ);
+  OUT(OS_PeriodicEventPeak());
+}
+void static Report0(void){
+  OUT(Time); OUT(Steps); OUT(SoundRMS); OUT(LightData); OUT(TemperatureData);
+  OUT(LostTask1Data); OUT(Count7);
+  OUT(OS_PeriodicEventPeak());
+}
+
+int(* const Programs[6])(void) = {
+  &Lab3_main, &main_step1, &main_step2, &main_step3, &main_step4, &main_step5
+};
+void(* const Reports[6])(void) = {
+  &Report0, &Report1, &Report2, &Report3, &Report4, &Report5
+};
+
+int main(int argc, char **argv){
+  int step;
+  uint32_t time = 5000;
+  if(argc < 2){
+    fprintf(stderr, "usage: %s step [msec]\n", argv[0]);
+    return 1;
+  }
+  step = atoi(argv[1]);
+  if((step < 0) || (step > 5)){
+    fprintf(stderr, "step is 0 to 5\n");
+    return 1;
+  }
+  if(argc > 2){
+    time = atoi(argv[2]);
+  }
+  Host_Init();
+  Host_RunFor(time, Reports[step]);
+  return Programs[step]();   // does not return
+}
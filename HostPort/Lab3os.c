@@ -0,0 +1,43 @@
+// Lab3os.c
+// Runs on Linux, host port of the kernel
+// The Lab 3 interface of Lab3/os.h, built on the priority kernel in
+// WorldShapers_4C123/os.c, so Lab3.c runs against that kernel.
+// The six main threads have equal priority and run round robin.
+// Event threads run from BSP_PeriodicTask_InitC every 1 msec, with
+// OS_AddPeriodicEventThread and the table of ../Lab3/events.c.
+
+#include <stdint.h>
+#include "../WorldShapers_4C123/os.h"
+#include "inc/BSP.h"
+#include "inc/CortexM.h"
+#include "../Lab3/events.h"
+
+#define MAINPRIORITY 1 // priority of the six main threads
+
+//******** OS_AddThreads ***************
+// Add six main threads to the scheduler
+// Inputs: function pointers to six void/void main threads
+// Outputs: 1 if successful, 0 if this thread can not be added
+// This function will only be called once, after OS_Init and before OS_Launch
+int OS_AddThreads(void(*thread0)(void),
+                  void(*thread1)(void),
+                  void(*thread2)(void),
+                  void(*thread3)(void),
+                  void(*thread4)(void),
+                  void(*thread5)(void)){
+  return OS_AddThread(thread0, MAINPRIORITY) && OS_AddThread(thread1, MAINPRIORITY)
+      && OS_AddThread(thread2, MAINPRIORITY) && OS_AddThread(thread3, MAINPRIORITY)
+      && OS_AddThread(thread4, MAINPRIORITY) && OS_AddThread(thread5, MAINPRIORITY);
+}
+
+//******** Lab3_Launch ***************
+// OS_Launch of Lab3.c, which is compiled with OS_Launch renamed to
+// this: builds the table of the event threads, in ../Lab3/events.c
+// like the board, starts their 1 ms interrupt, then the kernel
+// Inputs: number of clock cycles for each time slice
+// Outputs: none (does not return)
+void Lab3_Launch(uint32_t theTimeSlice){
+  EventSchedule();       // phases and table of the event threads
+  BSP_PeriodicTask_InitC(&RunEvents, 1000, 0);
+  OS_Launch(theTimeSlice);
+}
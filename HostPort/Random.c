@@ -0,0 +1,28 @@
+// Random.c
+// Runs on Linux, host port of the kernel
+// Replaces ../WorldShapers_4C123/random.s, the same linear congruential
+// generator, so WorldShapers.c makes the same choices as on the board.
+
+#include <stdint.h>
+#include "inc/Random.h"
+
+uint32_t static M;
+
+// random.s ignores the seed and always starts from 1
+void Random_Init(uint32_t seed){
+  (void)seed;
+  M = 1;
+}
+
+uint32_t Random32(void){
+  M = 1664525*M+1013904223;
+  return M;
+}
+
+uint32_t Random16(void){
+  return Random32()>>16;  // top 16 bits
+}
+
+uint32_t Random(void){
+  return Random32()>>24;  // top 8 bits
+}
@@ -0,0 +1,177 @@
+// SimMain.c
+// Runs on Linux, host port of the kernel, built with HOST_SIM=1
+// Runs ../WorldShapers_4C123/WorldShapers.c on the virtual clock, with
+// button 1 and the joystick driven by a file of events or made up from
+// a seed, then prints what it measured, one name=value per line.  The
+// same arguments give the same output every time, so a change to the
+// kernel can be checked run against run.
+//   ./worldsim [-s seed] [-t msec] [-e events] [-o trace]
+// -s seed   makes up the input when there is no -e (default 1)
+// -t msec   virtual time to run (default 60000)
+// -e events file of input events in order of time, one per line
+//             <msec> button              press and release button 1
+//             <msec> joystick <x> <y>    move the joystick, 0 to 1023
+//           lines that start with # are skipped
+// -o trace  write the kernel events there, for tracejson
+// Every 10 ms the kernel events are taken with OS_TraceDump; tracehash
+// is a hash of all of them, so equal hashes mean equal schedules.
+// WorldShapers.c is compiled with main renamed to WorldShapers_main.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "Host.h"
+#include "../WorldShapers_4C123/os.h"
+
+#define DUMPMS 10        // msec between OS_TraceDump calls, fewer than 256 events
+
+int WorldShapers_main(void);
+
+// in WorldShapers.c
+struct latency{
+  uint32_t Min;   // shortest, bus cycles
+  uint32_t Max;   // longest, bus cycles
+  uint32_t Sum;   // Sum/Num is the average
+  uint32_t Num;   // number of times measured
+};
+extern struct latency GameLatency, ButtonLatency;
+extern uint32_t Score, IsrPercent;
+extern int CurrentLevel;
+
+uint32_t static Seed = 1;
+uint32_t static Time = 60000;   // msec to run
+FILE static *Events;            // input events, 0 to make them up
+FILE static *TraceFile;         // copy of the kernel events, 0 for none
+uint32_t static Ms;             // virtual msec since the start
+uint32_t static NextMs;         // msec of the next input event
+char static Kind[16];           // and what it is, from the events file
+uint32_t static X,Y;            // where it moves the joystick
+uint32_t static NextMove;       // msec the made up joystick moves next
+uint32_t static Hash = 2166136261u; // FNV-1a of the OS_TraceDump lines
+uint32_t static NumEvents;      // kernel events taken
+uint32_t static FullDumps;      // dumps with TraceBuf full, some may be lost
+
+// xorshift, for the made up input
+uint32_t static Rand(void){
+  Seed ^= Seed<<13;
+  Seed ^= Seed>>17;
+  Seed ^= Seed<<5;
+  return Seed;
+}
+
+void static TraceOut(char c){
+  Hash = (Hash^(uint8_t)c)*16777619u;
+  if(TraceFile){
+    fputc(c, TraceFile);
+  }
+}
+
+void static TakeTrace(void){
+  uint32_t n = OS_TraceDump(&TraceOut);
+  NumEvents += n;
+  if(n >= 256){
+    FullDumps++;
+  }
+}
+
+// read the next line of the events file, NextMs is 0xFFFFFFFF at the end
+void static NextEvent(void){
+  char line[128];
+  while(fgets(line, sizeof(line), Events)){
+    if((line[0] != '#') &&
+       (sscanf(line, "%u %15s %u %u", &NextMs, Kind, &X, &Y) >= 2)){
+      return;
+    }
+  }
+  NextMs = 0xFFFFFFFF;
+}
+
+// the input due this msec, from the file or made up
+void static Input(void){
+  if(Events){
+    while(NextMs <= Ms){
+      if(Kind[0] == 'b'){
+        Host_Button1();
+      } else if(Kind[0] == 'j'){
+        Host_Joystick(X, Y, 1);
+      }
+      NextEvent();
+    }
+    return;
+  }
+  if(Ms >= NextMs){
+    Host_Button1();
+    NextMs = Ms+50+Rand()%400;      // a press every 50 to 450 ms
+  }
+  if(Ms >= NextMove){
+    Host_Joystick(Rand()%1024, Rand()%1024, 1);
+    NextMove = Ms+200+Rand()%1800;  // holds it 0.2 to 2 s
+  }
+}
+
+// runs at the start of each virtual msec, in the host tick interrupt
+void static EveryMs(void){
+  Ms++;
+  Input();
+  if((Ms%DUMPMS) == 0){
+    TakeTrace();
+  }
+}
+
+#define OUT(x) printf("%s=%ld\n", #x, (long)(x))
+
+void static OutLatency(const char *name, struct latency *l){
+  printf("%s=%u,%u,%u,%u\n", name, l->Num ? l->Min : 0, l->Max,
+    l->Num ? l->Sum/l->Num : 0, l->Num);
+}
+
+void static Report(void){
+  TakeTrace();           // the events since the last one
+  if(TraceFile){
+    fflush(TraceFile);
+  }
+  OUT(Ms); OUT(Score); OUT(CurrentLevel); OUT(IsrPercent);
+  OutLatency("GameLatency", &GameLatency);   // min,max,average,number in bus cycles
+  OutLatency("ButtonLatency", &ButtonLatency);
+  OUT(NumEvents); OUT(FullDumps);
+  printf("tracehash=%08X\n", Hash);
+}
+
+int main(int argc, char **argv){
+  int opt;
+  char *events = 0;
+  while((opt = getopt(argc, argv, "s:t:e:o:")) != -1){
+    switch(opt){
+    case 's': Seed = strtoul(optarg, 0, 0); break;
+    case 't': Time = strtoul(optarg, 0, 0); break;
+    case 'e': events = optarg; break;
+    case 'o':
+      TraceFile = fopen(optarg, "w");
+      if(TraceFile == 0){
+        perror(optarg);
+        return 1;
+      }
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed] [-t msec] [-e events] [-o trace]\n", argv[0]);
+      return 1;
+    }
+  }
+  if(events){
+    Events = fopen(events, "r");
+    if(Events == 0){
+      perror(events);
+      return 1;
+    }
+    NextEvent();
+  }
+  if(Seed == 0){
+    Seed = 1;            // xorshift stays at 0
+  }
+  printf("seed=%u\n", Seed);
+  Host_Init();
+  Host_EveryMs(&EveryMs);
+  Host_RunFor(Time, &Report);
+  return WorldShapers_main(); // does not return
+}
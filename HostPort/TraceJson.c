@@ -0,0 +1,158 @@
+// TraceJson.c
+// Runs on Linux
+// Reads the lines OS_TraceDump sends (see ../WorldShapers_4C123/os.h)
+// and writes them as a Chrome trace, for chrome://tracing or
+// ui.perfetto.dev.  Other lines, like KernelBench rows, are skipped.
+//   ./tracejson < dump.txt > trace.json
+// Each thread gets a track with a slice for each time it ran, and
+// marks for its waits, signals, queue operations, sleeps and kill;
+// time in interrupts that call OS_IsrEnter is a track of its own.
+// Dumps that follow each other, like those of worldsim -o, continue
+// the same tracks unless events were written over in between.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "../WorldShapers_4C123/os.h"
+
+#define ISRTID 1000  // track of the interrupts, above any 8-bit Id
+
+const char * const Names[12] = {
+  "", "switch", "wait", "block", "signal", "put", "get", "drop",
+  "sleep", "kill", "isrenter", "isrexit"
+};
+
+uint32_t static Freq = 80000000; // bus Hz, from the trace line
+uint64_t static Cycles;          // DWT_CYCCNT of the last event, without wrapping
+uint32_t static Last;            // DWT_CYCCNT of the last event
+int static Started;              // an event has been read since the start, or a gap
+int static Running;              // Id of the thread running, -1 if not known
+uint64_t static RunStart;        // when it was switched in
+uint32_t static IsrDepth;        // interrupts entered and not left
+uint64_t static IsrStart;        // when the outermost one was entered
+int static First = 1;            // no event written yet
+uint32_t static Named[256][3];   // Id, task and priority each track was named with
+
+// ******** Out ************
+// Start one event of the trace, with a comma before all but the first
+// Inputs:  ph of the event, its name, track, time in bus cycles
+// Outputs: none
+void static Out(const char *ph, const char *name, int tid, uint64_t time){
+  printf("%s\n{\"ph\":\"%s\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+    First ? "" : ",", ph, name, tid, (double)time*1e6/Freq);
+  First = 0;
+}
+
+// ******** Slice ************
+// Write a slice of time on a track
+// Inputs:  name, track, start and end in bus cycles
+// Outputs: none
+void static Slice(const char *name, int tid, uint64_t start, uint64_t end){
+  Out("X", name, tid, start);
+  printf(",\"dur\":%.3f}", (double)(end-start)*1e6/Freq);
+}
+
+// ******** Event ************
+// Write one recorded kernel event
+// Inputs:  DWT_CYCCNT, TRACE_SWITCH to TRACE_ISREXIT, Id, Arg
+// Outputs: none
+void static Event(uint32_t time, uint32_t event, uint32_t id, uint32_t arg){
+  if(Started){
+    Cycles += (uint32_t)(time-Last); // events are less than 53 s apart
+  } else{
+    Running = id;        // it ran from before the first event
+    RunStart = Cycles;
+    Started = 1;
+  }
+  Last = time;
+  switch(event){
+  case TRACE_SWITCH:
+    if(Running >= 0){
+      Slice("run", Running, RunStart, Cycles);
+    }
+    Running = arg&0xFF;
+    RunStart = Cycles;
+    break;
+  case TRACE_ISRENTER:
+    if(IsrDepth == 0){
+      IsrStart = Cycles;
+    }
+    IsrDepth++;
+    break;
+  case TRACE_ISREXIT:
+    if(IsrDepth){        // 0 if entered before the first event
+      IsrDepth--;
+      if(IsrDepth == 0){
+        Slice("interrupt", ISRTID, IsrStart, Cycles);
+      }
+    }
+    break;
+  case TRACE_SLEEP:
+    Out("i", Names[event], id, Cycles);
+    printf(",\"s\":\"t\",\"args\":{\"msec\":%u}}", arg);
+    break;
+  case TRACE_KILL:
+    Out("i", Names[event], id, Cycles);
+    printf(",\"s\":\"t\"}");
+    break;
+  default:
+    if((event == 0) || (event > TRACE_ISREXIT)){
+      fprintf(stderr, "unknown event %u\n", event);
+      return;
+    }
+    Out("i", Names[event], id, Cycles);
+    printf(",\"s\":\"t\",\"args\":{\"object\":\"0x%04X\"}}", arg);
+  }
+}
+
+// ******** Finish ************
+// Close the slices still open at the last event
+// Inputs:  none
+// Outputs: none
+void static Finish(void){
+  if(Started && (Running >= 0)){
+    Slice("run", Running, RunStart, Cycles);
+  }
+  if(Started && IsrDepth){
+    Slice("interrupt", ISRTID, IsrStart, Cycles);
+  }
+  Started = 0;
+  IsrDepth = 0;
+}
+
+int main(void){
+  char line[128],*pt;
+  uint32_t time,event,id,arg,lost,task,priority;
+  printf("{\"traceEvents\":[");
+  Out("M", "thread_name", ISRTID, 0);
+  printf(",\"args\":{\"name\":\"interrupts\"}}");
+  while(fgets(line, sizeof(line), stdin)){
+    pt = line;
+    while(*pt == '\r'){
+      pt++;              // OS_TraceDump ends lines with \n\r
+    }
+    if(sscanf(pt, "trace,%x,%x", &Freq, &lost) == 2){
+      if(Freq == 0){
+        Freq = 80000000;
+      }
+      if(lost){
+        Finish();        // the tracks have a gap
+        fprintf(stderr, "%u events were written over\n", lost);
+      }
+    } else if(sscanf(pt, "thread,%x,%x,%x", &id, &task, &priority) == 3){
+      if((Named[id&0xFF][0] != id) || (Named[id&0xFF][1] != task) || (Named[id&0xFF][2] != priority)){
+        Named[id&0xFF][0] = id;
+        Named[id&0xFF][1] = task;
+        Named[id&0xFF][2] = priority;
+        Out("M", "thread_name", id&0xFF, 0);
+        printf(",\"args\":{\"name\":\"Id %u task 0x%08X priority %u\"}}", id, task, priority);
+      }
+    } else if((strlen(pt) >= 19) && (pt[8] == ',') && (pt[11] == ',') && (pt[14] == ',') &&
+              (sscanf(pt, "%8x,%2x,%2x,%4x", &time, &event, &id, &arg) == 4)){
+      Event(time, event, id, arg);
+    }
+  }
+  Finish();
+  printf("\n],\"displayTimeUnit\":\"ns\"}\n");
+  return 0;
+}
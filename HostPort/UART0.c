@@ -0,0 +1,29 @@
+// UART0.c
+// Runs on Linux, host port of the kernel
+// UART0 output goes to stdout, carriage returns are dropped
+// so "\n\r" line endings come out as plain newlines
+
+#include <stdint.h>
+#include <stdio.h>
+#include "inc/UART0.h"
+
+void UART0_Init(void){
+  setvbuf(stdout, 0, _IOLBF, 0);
+}
+void UART0_OutChar(char data){
+  if(data != '\r'){
+    putchar(data);
+  }
+}
+void UART0_OutString(char *pt){
+  while(*pt){
+    UART0_OutChar(*pt);
+    pt++;
+  }
+}
+void UART0_OutUDec(uint32_t n){
+  printf("%u", n);
+}
+void UART0_OutUHex(uint32_t number){
+  printf("%X", number);
+}
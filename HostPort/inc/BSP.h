@@ -0,0 +1,12 @@
+// BSP.h
+// Runs on Linux, host port of the kernel
+// Same functions as the MKII board support package, the sensors
+// return fixed readings and the LCD, LED and buzzer do nothing.
+// The three periodic tasks run from the host tick in CortexM.c,
+// and button 1 (PD6) is pressed with kill -USR1.
+
+#ifndef __BSP_H
+#define __BSP_H  1
+#include <stdint.h>
+#include "../../Lab3/BSP.h"
+#endif
@@ -0,0 +1,63 @@
+// CortexM.h
+// Runs on Linux, host port of the kernel
+// Same functions as inc/CortexM.h for the TM4C123.  The core registers
+// the kernel touches are ordinary variables, and the I bit is modeled
+// by blocking the signals that stand in for interrupts (see CortexM.c).
+
+#ifndef __CORTEXM_H
+#define __CORTEXM_H  1
+#include <stdint.h>
+
+// SysTick and System Control Block registers used by os.c
+// SysTick_Handler runs when STCURRENT counts down, if STCTRL is 0x07
+// writing 0x10000000 to INTCTRL does nothing, use ContextSwitch
+extern volatile uint32_t STCTRL;
+extern volatile uint32_t STRELOAD;
+extern volatile uint32_t STCURRENT;
+extern volatile uint32_t SYSPRI3;
+extern volatile uint32_t INTCTRL;
+
+// DWT cycle counter, bus cycles at 80 MHz from the host clock
+// it always runs, writes to it and to DEMCR and DWT_CTRL do nothing
+extern volatile uint32_t DEMCR;
+extern volatile uint32_t DWT_CTRL;
+uint32_t volatile *Host_CycleCounter(void);
+#define DWT_CYCCNT (*Host_CycleCounter())
+
+// count leading zeros, an ARM compiler intrinsic on the board
+#define __clz(x) ((uint32_t)__builtin_clz(x))
+
+//******** DisableInterrupts ************
+// sets the I bit in the PRIMASK to disable interrupts
+// Inputs: none
+// Outputs: none
+void DisableInterrupts(void); // Disable interrupts
+
+//******** EnableInterrupts ************
+// clears the I bit in the PRIMASK to enable interrupts
+// a pending PendSV is taken here
+// Inputs: none
+// Outputs: none
+void EnableInterrupts(void);  // Enable interrupts
+
+//******** StartCritical ************
+// StartCritical saves a copy of PRIMASK and disables interrupts
+// Code between StartCritical and EndCritical is run atomically
+// Inputs: none
+// Outputs: copy of the PRIMASK (I bit) before StartCritical called
+long StartCritical(void);
+
+//******** EndCritical ************
+// EndCritical sets PRIMASK with value passed in
+// Code between StartCritical and EndCritical is run atomically
+// Inputs: PRIMASK (I bit) before StartCritical called
+// Outputs: none
+void EndCritical(long sr);    // restore I bit to previous value
+
+//******** WaitForInterrupt ************
+// sleeps until the next interrupt
+// Inputs: none
+// Outputs: none
+void WaitForInterrupt(void);
+
+#endif
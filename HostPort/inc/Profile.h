@@ -0,0 +1,17 @@
+// Profile.h
+// Runs on Linux, host port of the kernel
+// The profiling pins are not connected, these functions do nothing
+
+#ifndef __PROFILE_H
+#define __PROFILE_H  1
+
+void Profile_Init(void);
+void Profile_Toggle0(void);
+void Profile_Toggle1(void);
+void Profile_Toggle2(void);
+void Profile_Toggle3(void);
+void Profile_Toggle4(void);
+void Profile_Toggle5(void);
+void Profile_Toggle6(void);
+
+#endif
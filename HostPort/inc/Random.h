@@ -0,0 +1,10 @@
+// Random.h
+// Runs on Linux, host port of the kernel
+// WorldShapers.c includes "Random.h" but the file is random.h, which
+// only Keil finds; this includes it, and Random.c replaces random.s.
+
+#ifndef __RANDOM_H
+#define __RANDOM_H  1
+#include <stdint.h>
+#include "../../WorldShapers_4C123/random.h"
+#endif
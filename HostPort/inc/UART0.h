@@ -0,0 +1,15 @@
+// UART0.h
+// Runs on Linux, host port of the kernel
+// UART0 output goes to stdout, there is no input
+
+#ifndef __UART0_H
+#define __UART0_H  1
+#include <stdint.h>
+
+void UART0_Init(void);
+void UART0_OutChar(char data);
+void UART0_OutString(char *pt);
+void UART0_OutUDec(uint32_t n);
+void UART0_OutUHex(uint32_t number);
+
+#endif
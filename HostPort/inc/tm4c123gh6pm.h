@@ -0,0 +1,69 @@
+// tm4c123gh6pm.h
+// Runs on Linux, host port of the kernel
+// The TM4C123 peripheral registers used by the kernel, as variables.
+// They are defined in BSP.c, which defines HOST_REGISTER first.
+
+#ifndef __TM4C123GH6PM_H
+#define __TM4C123GH6PM_H  1
+#include <stdint.h>
+
+#ifndef HOST_REGISTER
+#define HOST_REGISTER(name) extern volatile uint32_t name;
+#endif
+
+HOST_REGISTER(SYSCTL_RCGCGPIO_R)
+HOST_REGISTER(SYSCTL_PRGPIO_R)     // reads all ready
+HOST_REGISTER(SYSCTL_RCGCTIMER_R)
+HOST_REGISTER(SYSCTL_PRTIMER_R)    // reads all ready
+HOST_REGISTER(NVIC_EN0_R)
+HOST_REGISTER(NVIC_EN2_R)
+HOST_REGISTER(NVIC_UNPEND2_R)
+HOST_REGISTER(NVIC_PRI0_R)
+HOST_REGISTER(NVIC_PRI1_R)
+HOST_REGISTER(NVIC_PRI7_R)
+HOST_REGISTER(NVIC_PRI17_R)
+HOST_REGISTER(TIMER4_CFG_R)        // Timer4A, one-shot only, see Host_Timer4
+HOST_REGISTER(TIMER4_TAMR_R)
+HOST_REGISTER(TIMER4_CTL_R)
+HOST_REGISTER(TIMER4_IMR_R)
+HOST_REGISTER(TIMER4_ICR_R)
+HOST_REGISTER(TIMER4_TAILR_R)
+HOST_REGISTER(TIMER4_TAPR_R)
+HOST_REGISTER(Host_Timer4RIS)
+HOST_REGISTER(Host_Timer4TAV)
+
+// Timer4A counts on the host clock in CortexM.c, which sees the writes
+// to ICR and CTL when RIS or TAV is read or at the next host tick, and
+// runs TIMER4A_Handler from the host tick when it times out
+volatile uint32_t *Host_Timer4(volatile uint32_t *reg);
+#define TIMER4_RIS_R (*Host_Timer4(&Host_Timer4RIS))
+#define TIMER4_TAV_R (*Host_Timer4(&Host_Timer4TAV))
+
+// GPIO ports A to F, each a block of registers at the offsets they
+// have on the board, so os.c can reach them from the port address
+// (GPIOPORTS); ICR does not clear RIS, CortexM.c does
+extern volatile uint32_t Host_Gpio[6][0x540/4];
+#define GPIOPORTS {Host_Gpio[0], Host_Gpio[1], Host_Gpio[2], \
+                   Host_Gpio[3], Host_Gpio[4], Host_Gpio[5]}
+#define GPIO_PORTD_DATA_R  (Host_Gpio[3][0x3FC/4])
+#define GPIO_PORTD_DIR_R   (Host_Gpio[3][0x400/4])
+#define GPIO_PORTD_IS_R    (Host_Gpio[3][0x404/4])
+#define GPIO_PORTD_IBE_R   (Host_Gpio[3][0x408/4])
+#define GPIO_PORTD_IEV_R   (Host_Gpio[3][0x40C/4])
+#define GPIO_PORTD_IM_R    (Host_Gpio[3][0x410/4])
+#define GPIO_PORTD_RIS_R   (Host_Gpio[3][0x414/4]) // bit 6 set by SIGUSR1
+#define GPIO_PORTD_ICR_R   (Host_Gpio[3][0x41C/4])
+#define GPIO_PORTD_AFSEL_R (Host_Gpio[3][0x420/4])
+#define GPIO_PORTD_PUR_R   (Host_Gpio[3][0x510/4])
+#define GPIO_PORTD_DEN_R   (Host_Gpio[3][0x51C/4])
+#define GPIO_PORTD_AMSEL_R (Host_Gpio[3][0x528/4])
+#define GPIO_PORTD_PCTL_R  (Host_Gpio[3][0x52C/4])
+
+#define TIMER_CFG_32_BIT_TIMER  0x00000000  // 32-bit timer configuration
+#define TIMER_TAMR_TAMR_1_SHOT  0x00000001  // One-Shot Timer mode
+#define TIMER_CTL_TAEN          0x00000001  // GPTM Timer A Enable
+#define TIMER_IMR_TATOIM        0x00000001  // GPTM Timer A Time-Out Interrupt Mask
+#define TIMER_RIS_TATORIS       0x00000001  // GPTM Timer A Time-Out Raw Interrupt
+#define TIMER_ICR_TATOCINT      0x00000001  // GPTM Timer A Time-Out Raw Interrupt
+
+#endif
@@ -0,0 +1,84 @@
+// osasm.c
+// Runs on Linux, host port of the kernel
+// Replaces osasm.s: StartOS and PendSV_Handler switch threads with
+// ucontext instead of pushing R4-R11 on the thread stack.
+// The kernel only ever stores RunPt->sp and loads it back, so here
+// the sp field holds the address of the host context of the thread.
+// A thread that has never run still has the stack frame built by
+// OS_AddThread, and its entry point is read from the PC in that frame.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include "inc/CortexM.h"
+#include "Host.h"
+
+void Scheduler(void);      // in os.c, chooses next RunPt
+extern void *RunPt;        // in os.c, the first field of the TCB is sp
+
+#define NUMCONTEXTS 128    // more than NUMTHREADS, power of 2
+#define CONTEXTSTACK 65536 // bytes of host stack per thread
+#define FRAME_PC 16        // PC in the frame from OS_AddThread, R4 is at sp[0]
+
+struct context{
+  void *Tcb;               // thread using this context, 0 if never used
+  ucontext_t Uc;           // registers and signal mask
+  void(*Task)(void);       // entry point
+  char *Stack;
+};
+struct context static Contexts[NUMCONTEXTS];
+
+// the context of a TCB, each TCB keeps the same one when it is reused
+struct context static *Context(void *tcb){
+  uint32_t i = (uint32_t)(((uintptr_t)tcb)>>4)&(NUMCONTEXTS-1);
+  while(Contexts[i].Tcb != tcb){
+    if(Contexts[i].Tcb == 0){
+      Contexts[i].Tcb = tcb;
+      Contexts[i].Stack = malloc(CONTEXTSTACK);
+      break;
+    }
+    i = (i+1)&(NUMCONTEXTS-1);
+  }
+  return &Contexts[i];
+}
+
+void static ThreadStart(void){
+  struct context *pt = Context(RunPt);
+  EnableInterrupts();      // threads run with interrupts enabled
+  pt->Task();
+  fprintf(stderr, "thread returned\n"); // on the board it jumps to 0x14141414
+  exit(1);
+}
+
+// sp of the running thread, the first field of its TCB
+#define RUNSP (*(int32_t **)RunPt)
+
+// give RunPt a host context if it still has the frame from OS_AddThread
+struct context static *Load(void){
+  struct context *pt = Context(RunPt);
+  if(RUNSP != (int32_t *)pt){
+    pt->Task = (void(*)(void))(uintptr_t)(uint32_t)RUNSP[FRAME_PC];
+    getcontext(&pt->Uc);         // signal mask has the interrupts blocked
+    pt->Uc.uc_stack.ss_sp = pt->Stack;
+    pt->Uc.uc_stack.ss_size = CONTEXTSTACK;
+    pt->Uc.uc_link = 0;
+    makecontext(&pt->Uc, &ThreadStart, 0);
+    RUNSP = (int32_t *)pt;
+  }
+  return pt;
+}
+
+void StartOS(void){
+  setcontext(&Load()->Uc);
+}
+
+// called with interrupts disabled, by Host_PendSV
+void PendSV_Handler(void){
+  struct context *old = Context(RunPt);
+  RUNSP = (int32_t *)old;  // save SP into TCB
+  Scheduler();             // RunPt = next thread to run
+  if(Context(RunPt) != old){
+    swapcontext(&old->Uc, &Load()->Uc);
+  }
+}
@@ -0,0 +1,526 @@
+// KernelBench.c
+// Runs on TM4C123
+// Micro-benchmarks for the priority/blocking real-time operating system
+// in WorldShapers_4C123, timed with the DWT cycle counter
+// Results are sent to UART0 (115200 bps) as comma separated rows
+//   test,threads,cycles
+// so runs of different kernel versions can be compared line by line
+
+// Build with ../WorldShapers_4C123/os.c and osasm.s, and define
+// NUMTHREADS=64 so the largest thread counts fit in the TCB table
+// (see Readme.txt).  ../HostPort builds the same program for Linux.
+
+#include <stdint.h>
+#include "../inc/BSP.h"
+#include "../inc/CortexM.h"
+#include "../inc/UART0.h"
+#include "../WorldShapers_4C123/os.h"
+
+#ifndef DWT_CYCCNT       // HostPort defines these from the host clock
+#define DEMCR      (*((volatile uint32_t *)0xE000EDFC))
+#define DWT_CTRL   (*((volatile uint32_t *)0xE0001000))
+#define DWT_CYCCNT (*((volatile uint32_t *)0xE0001004))
+#endif
+
+void Scheduler(void);    // in os.c, chooses next RunPt
+
+#define REPEATS 1000     // number of times each measured operation runs
+#define SLEEPS  100      // number of sleeps timed for wake up jitter
+uint32_t BenchDone;      // set when all rows have been sent
+#ifndef BENCHTRACE
+#define BENCHTRACE 0     // 1 sends the kernel events of the last tests after the rows
+#endif
+
+// ********OutRow**********
+// Send one result row to the PC
+// Inputs:  test name, number of threads, cycles per operation
+// Outputs: none
+void OutRow(char *test, uint32_t threads, uint32_t cycles){
+  UART0_OutString(test);
+  UART0_OutChar(',');
+  UART0_OutUDec(threads);
+  UART0_OutChar(',');
+  UART0_OutUDec(cycles);
+  UART0_OutString("\n\r");
+}
+
+void Dummy(void){ // benchmark threads are created but never launched
+  while(1){
+  }
+}
+
+//---------------- Scheduler cost ----------------
+// The ready threads are spread over four priorities, so Scheduler
+// runs round robin at the highest one.  The old scheduler walked
+// every TCB in the ring on every call; it is reproduced here with
+// the same mix so both rows can be compared at each thread count.
+struct scantcb{
+  struct scantcb *next;
+  uint32_t Blocked;
+  uint32_t Sleep;
+  uint32_t Priority;
+};
+struct scantcb ScanTcbs[64];
+struct scantcb *ScanPt;
+void ScanScheduler(void){ // previous ring scan, for comparison
+  uint32_t max = 255;
+  struct scantcb *pt;
+  struct scantcb *bestPt = ScanPt;
+  pt = ScanPt;
+  do{
+    pt = pt->next;
+    if((pt->Priority < max) && (pt->Blocked == 0) && (pt->Sleep == 0)){
+      bestPt = pt;
+      max = pt->Priority;
+    }
+  } while(ScanPt != pt);
+  ScanPt = bestPt;
+}
+const uint32_t ThreadCounts[5] = {4, 8, 16, 32, 64};
+void Bench_Scheduler(void){ int i,n,k;
+  uint32_t start,cycles;
+  for(i=0; i<5; i++){
+    n = ThreadCounts[i];
+    OS_Init();
+    for(k=0; k<n; k++){
+      if(OS_AddThread(&Dummy, 1+(k&3)) == 0){
+        return;    // NUMTHREADS is too small for this count
+      }
+    }
+    start = DWT_CYCCNT;
+    for(k=0; k<REPEATS; k++){
+      Scheduler();
+    }
+    cycles = (DWT_CYCCNT-start)/REPEATS;
+    OutRow("sched", n, cycles);
+    for(k=0; k<n; k++){
+      ScanTcbs[k].next = &ScanTcbs[(k+1)%n];
+      ScanTcbs[k].Blocked = 0;
+      ScanTcbs[k].Sleep = 0;
+      ScanTcbs[k].Priority = 1+(k&3);
+    }
+    ScanPt = &ScanTcbs[0];
+    start = DWT_CYCCNT;
+    for(k=0; k<REPEATS; k++){
+      ScanScheduler();
+    }
+    cycles = (DWT_CYCCNT-start)/REPEATS;
+    OutRow("scan", n, cycles);
+  }
+}
+
+//---------------- Running kernel ----------------
+// The remaining tests run after OS_Launch.  Bench, at the highest
+// priority, starts the threads for each test at priority 2 and
+// blocks on Done until they have finished and killed themselves.
+// The idle thread OS_Launch adds is always ready.
+int32_t Done;            // signaled by each test thread as it finishes
+uint32_t Started;        // set by the first test thread to run
+uint32_t Start,End;      // DWT_CYCCNT at first start and last finish
+void TestStart(void){
+  if(Started == 0){
+    Started = 1;
+    Start = DWT_CYCCNT;
+  }
+}
+void TestEnd(void){
+  End = DWT_CYCCNT;
+  OS_Signal(&Done);
+  OS_Kill();
+}
+// runs one or two test threads (thread1 0 for one),
+// returns cycles from first start to last finish
+uint32_t RunTest(void(*thread0)(void), void(*thread1)(void)){
+  Started = 0;
+  OS_InitSemaphore(&Done, 0);
+  OS_AddThread(thread0, 2);
+  if(thread1){
+    OS_AddThread(thread1, 2);
+    OS_Wait(&Done);
+  }
+  OS_Wait(&Done);
+  return End-Start;
+}
+
+// yield to yield, two threads taking turns with OS_Suspend
+void YieldTask(void){ int i;
+  TestStart();
+  for(i=0; i<REPEATS; i++){
+    OS_Suspend();
+  }
+  TestEnd();
+}
+
+// ping-pong, each round trip is a signal and a blocking wait on each side
+int32_t Ping,Pong;
+void PingTask(void){ int i;
+  TestStart();
+  for(i=0; i<REPEATS; i++){
+    OS_Signal(&Ping);
+    OS_Wait(&Pong);
+  }
+  TestEnd();
+}
+void PongTask(void){ int i;
+  TestStart();
+  for(i=0; i<REPEATS; i++){
+    OS_Wait(&Ping);
+    OS_Signal(&Pong);
+  }
+  TestEnd();
+}
+
+// the same round trip with two flags of one event group
+EventGroupType PingPong;
+#define PINGFLAG 0x01
+#define PONGFLAG 0x02
+void EventPingTask(void){ int i;
+  TestStart();
+  for(i=0; i<REPEATS; i++){
+    OS_SetEvents(&PingPong, PINGFLAG);
+    OS_WaitEvents(&PingPong, PONGFLAG, EVENT_ANY+EVENT_CLEAR);
+  }
+  TestEnd();
+}
+void EventPongTask(void){ int i;
+  TestStart();
+  for(i=0; i<REPEATS; i++){
+    OS_WaitEvents(&PingPong, PINGFLAG, EVENT_ANY+EVENT_CLEAR);
+    OS_SetEvents(&PingPong, PONGFLAG);
+  }
+  TestEnd();
+}
+
+// FIFO throughput, the producer fills the FIFO then yields,
+// the consumer empties it then blocks
+void ProducerTask(void){ uint32_t sent=0;
+  TestStart();
+  while(sent < REPEATS){
+    if(OS_FIFO_Put(sent) == 0){
+      sent++;
+    } else{
+      OS_Suspend();      // full
+    }
+  }
+  TestEnd();
+}
+void ConsumerTask(void){ int i;
+  TestStart();
+  for(i=0; i<REPEATS; i++){
+    OS_FIFO_Get();
+  }
+  TestEnd();
+}
+
+// queue throughput with 8-byte elements, the producer blocks when
+// it is full and the consumer blocks when it is empty
+struct sample{
+  uint32_t Time;
+  int32_t Value;
+};
+struct sample Samples[16];
+QueueType SampleQueue;
+void QueueProducerTask(void){ struct sample s; int i;
+  TestStart();
+  for(i=0; i<REPEATS; i++){
+    s.Time = i;
+    s.Value = -i;
+    OS_Queue_Put(&SampleQueue, &s);
+  }
+  TestEnd();
+}
+void QueueConsumerTask(void){ struct sample s; int i;
+  TestStart();
+  for(i=0; i<REPEATS; i++){
+    OS_Queue_Get(&SampleQueue, &s);
+  }
+  TestEnd();
+}
+
+// wake up jitter, time from calling OS_Sleep(10) to running again
+uint32_t SleepMin,SleepMax;
+void SleepTask(void){ int i; uint32_t start,cycles;
+  SleepMin = 0xFFFFFFFF;
+  SleepMax = 0;
+  for(i=0; i<SLEEPS; i++){
+    start = DWT_CYCCNT;
+    OS_Sleep(10);
+    cycles = DWT_CYCCNT-start;
+    if(cycles < SleepMin) SleepMin = cycles;
+    if(cycles > SleepMax) SleepMax = cycles;
+  }
+  TestEnd();
+}
+
+// OS_AddThread and OS_Kill cost, with other threads blocked on Never
+// taking up TCBs.  KillTask runs at the same priority as Bench, so
+// the kill time includes switching back to Bench.  A new thread joins
+// the end of the round robin, so Bench may get a turn before it runs.
+int32_t Never;           // Filler threads wait here until the test ends
+uint32_t KillStart;      // DWT_CYCCNT when KillTask called OS_Kill
+void Filler(void){
+  OS_Wait(&Never);
+  OS_Kill();
+}
+void KillTask(void){
+  DisableInterrupts();   // Bench must not run before the kill
+  KillStart = DWT_CYCCNT;
+  OS_Kill();
+}
+// returns 0 if NUMTHREADS is too small for n threads
+int AddFillers(uint32_t n){ uint32_t k;
+  OS_InitSemaphore(&Never, 0);
+  for(k=0; k<n-3; k++){  // Bench, Idle and KillTask are the other three
+    if(OS_AddThread(&Filler, 3) == 0){
+      return 0;
+    }
+  }
+  OS_Sleep(2);           // fillers run and block
+  return 1;
+}
+void KillFillers(uint32_t n){ uint32_t k;
+  for(k=0; k<n-3; k++){
+    OS_Signal(&Never);
+  }
+  OS_Sleep(2);           // fillers run and kill themselves
+}
+void Bench_AddKill(void){ int i,n,k;
+  uint32_t start,add,kill;
+  for(i=0; i<5; i++){
+    n = ThreadCounts[i];
+    if(AddFillers(n) == 0){
+      return;
+    }
+    add = 0;
+    kill = 0;
+    for(k=0; k<REPEATS; k++){
+      KillStart = 0;
+      start = DWT_CYCCNT;
+      OS_AddThread(&KillTask, 0);
+      add += DWT_CYCCNT-start;
+      while(KillStart == 0){
+        OS_Suspend();    // KillTask runs and kills itself
+      }
+      kill += DWT_CYCCNT-KillStart;
+    }
+    OutRow("add", n, add/REPEATS);
+    OutRow("kill", n, kill/REPEATS);
+    KillFillers(n);
+  }
+}
+
+// spawn throughput, as EnemyCreateTask does, each new thread
+// runs and kills itself before Bench adds the next one
+const uint32_t SpawnCounts[3] = {5, 15, 50};
+void Bench_Spawn(void){ int i,n,k;
+  uint32_t start;
+  for(i=0; i<3; i++){
+    n = SpawnCounts[i];
+    if(AddFillers(n) == 0){
+      return;
+    }
+    start = DWT_CYCCNT;
+    for(k=0; k<REPEATS; k++){
+      KillStart = 0;
+      OS_AddThread(&KillTask, 0);
+      while(KillStart == 0){
+        OS_Suspend();
+      }
+    }
+    OutRow("spawn", n, (DWT_CYCCNT-start)/REPEATS);
+    KillFillers(n);
+  }
+}
+
+// Priority inversion, Low holds a lock and High blocks on it while Hog,
+// between them in priority, wants the processor for HOG cycles.  With
+// OS_LockMutex Low inherits the priority of High, so High waits about
+// CRITICAL cycles; with a semaphore it also waits for all of Hog.
+#define CRITICAL 8000    // cycles Low holds the lock, 100 us
+#define HOG    800000    // cycles Hog runs, 10 ms
+MutexType Lock;
+int32_t LockSema;
+int32_t Locked;          // signaled by Low once it holds the lock
+uint32_t UseMutex;       // 1 to lock with OS_LockMutex, 0 with OS_Wait
+uint32_t HighBlocked;    // cycles High waited for the lock
+void Spin(uint32_t cycles){ uint32_t start = DWT_CYCCNT;
+  while((DWT_CYCCNT-start) < cycles){
+  }
+}
+void LowTask(void){
+  if(UseMutex) OS_LockMutex(&Lock); else OS_Wait(&LockSema);
+  OS_Signal(&Locked);    // Bench starts Hog and High
+  Spin(CRITICAL);
+  if(UseMutex) OS_UnlockMutex(&Lock); else OS_Signal(&LockSema);
+  TestEnd();
+}
+void HogTask(void){
+  Spin(HOG);
+  TestEnd();
+}
+void HighTask(void){ uint32_t start = DWT_CYCCNT;
+  if(UseMutex) OS_LockMutex(&Lock); else OS_Wait(&LockSema);
+  HighBlocked = DWT_CYCCNT-start;
+  if(UseMutex) OS_UnlockMutex(&Lock); else OS_Signal(&LockSema);
+  TestEnd();
+}
+// returns cycles High was blocked
+uint32_t Bench_Inversion(uint32_t useMutex){
+  UseMutex = useMutex;
+  OS_InitMutex(&Lock);
+  OS_InitSemaphore(&LockSema, 1);
+  OS_InitSemaphore(&Locked, 0);
+  OS_InitSemaphore(&Done, 0);
+  OS_AddThread(&LowTask, 4);
+  OS_Wait(&Locked);
+  OS_AddThread(&HogTask, 3);
+  OS_AddThread(&HighTask, 2);
+  OS_Wait(&Done);
+  OS_Wait(&Done);
+  OS_Wait(&Done);
+  return HighBlocked;
+}
+
+//---------------- interrupt to thread data ----------------
+// A periodic interrupt sends a sample to a thread at 1 kHz or 10 kHz.
+// The cost is the time taken from Counter, which counts at priority 6
+// while Bench sleeps for WINDOW msec, compared with the count of a
+// window with no samples just before, so interrupts, puts, wake ups,
+// switches and gets are all included.  On the host port the count
+// varies with host load, so these rows are mostly noise there; the
+// put rows, timed inside the interrupt, are not.
+#define WINDOW 500       // msec each rate is measured
+volatile uint32_t Counts;// incremented by Counter
+volatile uint32_t CounterStop; // set to end Counter
+void Counter(void){
+  while(CounterStop == 0){
+    Counts++;
+  }
+  TestEnd();
+}
+uint32_t IsrStop;        // set to end the consumer
+uint32_t Sent;           // samples put by the interrupt
+uint32_t PutCycles;      // cycles in OS_FIFO_Put or OS_Ring_Put, all samples
+RingType Ring;
+uint32_t RingBuffer[128];
+uint32_t Batch[64];
+void FifoProducer(void){ // periodic interrupt
+  uint32_t start = DWT_CYCCNT;
+  OS_FIFO_Put(Sent);
+  PutCycles += DWT_CYCCNT-start;
+  Sent++;
+}
+void RingProducer(void){ // periodic interrupt
+  uint32_t start = DWT_CYCCNT;
+  OS_Ring_Put(&Ring, Sent);
+  PutCycles += DWT_CYCCNT-start;
+  Sent++;
+}
+void FifoConsumer(void){
+  while(IsrStop == 0){
+    OS_FIFO_Get();       // woken for every sample
+  }
+  TestEnd();
+}
+void RingConsumer(void){
+  while(IsrStop == 0){
+    OS_Ring_Get(&Ring);  // woken when the ring becomes not empty
+  }
+  TestEnd();
+}
+void BatchConsumer(void){
+  while(IsrStop == 0){
+    OS_Ring_GetN(&Ring, Batch, 64);
+    OS_Sleep(5);         // lets up to 50 samples collect
+  }
+  TestEnd();
+}
+// counts of Counter in one window, and the cycles it took
+uint32_t Window(uint32_t *cycles){ uint32_t counts,start;
+  counts = Counts;
+  start = DWT_CYCCNT;
+  OS_Sleep(WINDOW);
+  *cycles = DWT_CYCCNT-start;
+  return Counts-counts;
+}
+// sends rows of the cycles used per sample, and in the put alone
+void Bench_Isr(char *test, char *put, void(*producer)(void), void(*consumer)(void), uint32_t freq){
+  uint32_t baseCounts,baseCycles,counts,cycles,idle;
+  IsrStop = 0;
+  Sent = 0;
+  PutCycles = 0;
+  OS_FIFO_Init();
+  OS_Ring_Init(&Ring, RingBuffer, 128);
+  baseCounts = Window(&baseCycles);
+  OS_AddThread(consumer, 1);
+  OS_Sleep(1);           // it runs and blocks
+  BSP_PeriodicTask_InitC(producer, freq, 2);
+  counts = Window(&cycles);
+  BSP_PeriodicTask_StopC();
+  OutRow(put, 2, PutCycles/Sent);
+  idle = (uint32_t)(((uint64_t)counts*baseCycles)/baseCounts);
+  if(idle > cycles){
+    idle = cycles;       // host noise
+  }
+  IsrStop = 1;
+  OS_InitSemaphore(&Done, 0);
+  producer();            // one more sample, so the consumer sees IsrStop
+  OS_Wait(&Done);
+  OutRow(test, 2, (cycles-idle)/Sent);
+}
+void Bench_IsrData(void){
+  OS_InitSemaphore(&Done, 0);
+  Counts = 0;
+  CounterStop = 0;
+  OS_AddThread(&Counter, 6);
+  Bench_Isr("fifo1khz", "fifoput1khz", &FifoProducer, &FifoConsumer, 1000);
+  Bench_Isr("ring1khz", "ringput1khz", &RingProducer, &RingConsumer, 1000);
+  Bench_Isr("batch1khz", "batchput1khz", &RingProducer, &BatchConsumer, 1000);
+  Bench_Isr("fifo10khz", "fifoput10khz", &FifoProducer, &FifoConsumer, 10000);
+  Bench_Isr("ring10khz", "ringput10khz", &RingProducer, &RingConsumer, 10000);
+  Bench_Isr("batch10khz", "batchput10khz", &RingProducer, &BatchConsumer, 10000);
+  CounterStop = 1;
+  OS_InitSemaphore(&Done, 0);
+  OS_Wait(&Done);
+}
+
+void Bench(void){
+  OutRow("yield", 2, RunTest(&YieldTask, &YieldTask)/(2*REPEATS));
+  OS_InitSemaphore(&Ping, 0);
+  OS_InitSemaphore(&Pong, 0);
+  OutRow("pingpong", 2, RunTest(&PingTask, &PongTask)/REPEATS);
+  OS_InitEventGroup(&PingPong, 0);
+  OutRow("events", 2, RunTest(&EventPingTask, &EventPongTask)/REPEATS);
+  OS_FIFO_Init();
+  OutRow("fifo", 2, RunTest(&ProducerTask, &ConsumerTask)/REPEATS);
+  OS_Queue_Init(&SampleQueue, Samples, sizeof(struct sample), 16);
+  OutRow("queue", 2, RunTest(&QueueProducerTask, &QueueConsumerTask)/REPEATS);
+  RunTest(&SleepTask, 0);
+  OutRow("sleep10min", 1, SleepMin);
+  OutRow("sleep10max", 1, SleepMax);
+  Bench_AddKill();
+  Bench_Spawn();
+  Bench_IsrData();
+  OutRow("mutexblock", 3, Bench_Inversion(1));
+  OutRow("semablock", 3, Bench_Inversion(0));
+#if BENCHTRACE
+  OS_TraceDump(&UART0_OutChar); // see OS_TraceDump in os.h, HostPort/tracejson reads it
+#endif
+  UART0_OutString("done\n\r");
+  BenchDone = 1;
+  OS_Kill();
+}
+
+int main(void){
+  OS_Init();          // bus clock at 80 MHz, interrupts disabled
+  UART0_Init();
+  DEMCR |= 0x01000000;  // enable trace, needed for DWT
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= 0x00000001; // enable cycle counter
+  UART0_OutString("\n\rtest,threads,cycles\n\r");
+  Bench_Scheduler();
+  OS_Init();          // remove the threads used to time Scheduler
+  OS_AddThread(&Bench, 0);
+  OS_Launch(BSP_Clock_GetFreq()/1000); // 1 ms time slice
+  return 0;           // this never executes
+}
@@ -0,0 +1,150 @@
+// events.c
+// Runs on LM4F120/TM4C123/MSP432, and on Linux in ../HostPort
+// Periodic event threads of os.h, for os.c and for HostPort/Lab3os.c,
+// which runs Lab3.c on the kernel in WorldShapers_4C123.
+// OS_Launch calls EventSchedule, and the 1 ms interrupt calls RunEvents.
+
+#include <stdint.h>
+#include "os.h"
+#include "events.h"
+#include "CortexM.h"
+
+// Event threads run from the 1 ms interrupt.  Each gets a phase, so
+// threads whose periods share factors do not all run on the same tick,
+// and a table gives the threads due on each tick of the hyperperiod
+// (least common multiple of the periods).  The interrupt runs just
+// the threads due now, with no counting down.
+#define NUMEVENTS 8      // maximum number of event threads, one bit each in Due
+#define HYPERMAX 1000    // longest hyperperiod in msec, entries of Due
+struct event{
+  void(*Task)(void);     // event thread, runs to completion
+  uint32_t Period;       // msec
+  uint32_t Phase;        // msec into the hyperperiod of its first run
+};
+struct event static Events[NUMEVENTS];
+uint32_t static NumEvents;
+uint32_t static HyperPeriod = 1; // msec, least common multiple of the periods
+uint8_t static Due[HYPERMAX];    // bit 7-i is set if Events[i] runs on this tick
+uint32_t static EventTick;       // msec into the hyperperiod
+uint32_t static EventPeak;       // most event threads due on one tick
+
+// ******** Gcd ************
+// Greatest common divisor, Euclid
+// Inputs:  two numbers, not both 0
+// Outputs: largest number dividing both
+uint32_t static Gcd(uint32_t a, uint32_t b){ uint32_t r;
+  while(b){
+    r = a%b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+// ******** EventCount ************
+// Number of event threads due on a tick
+// Inputs:  entry of Due
+// Outputs: number of bits set
+uint32_t static EventCount(uint32_t due){ uint32_t n = 0;
+  while(due){
+    due &= due-1;        // clear the lowest bit set
+    n++;
+  }
+  return n;
+}
+
+// ******** EventSchedule ************
+// Give each event thread a phase and fill Due.  Threads are placed
+// shortest period first, each at the phase whose busiest tick has the
+// fewest threads already placed, the earliest such phase if equal.
+// Called by OS_Launch, after the last OS_AddPeriodicEventThread
+// Inputs:  none
+// Outputs: none
+void EventSchedule(void){
+  uint32_t i,n,t,best,phase,load,worst,least;
+  uint32_t placed = 0;   // bit 7-i is set once Events[i] has a phase
+  for(t=0; t<HyperPeriod; t++){
+    Due[t] = 0;
+  }
+  EventPeak = 0;
+  for(n=0; n<NumEvents; n++){
+    best = NUMEVENTS;
+    for(i=0; i<NumEvents; i++){
+      if(((placed&(0x80>>i)) == 0) &&
+         ((best == NUMEVENTS) || (Events[i].Period < Events[best].Period))){
+        best = i;        // shortest period not yet placed
+      }
+    }
+    i = best;
+    least = NUMEVENTS+1;
+    for(phase=0; phase<Events[i].Period; phase++){
+      worst = 0;
+      for(t=phase; t<HyperPeriod; t=t+Events[i].Period){
+        load = EventCount(Due[t]);
+        if(load > worst){
+          worst = load;
+        }
+      }
+      if(worst < least){
+        least = worst;
+        Events[i].Phase = phase;
+      }
+    }
+    for(t=Events[i].Phase; t<HyperPeriod; t=t+Events[i].Period){
+      Due[t] |= 0x80>>i;
+    }
+    if(least+1 > EventPeak){
+      EventPeak = least+1;
+    }
+    placed |= 0x80>>i;
+  }
+  EventTick = HyperPeriod-1; // next tick starts the hyperperiod
+}
+
+// ******** RunEvents ************
+// Run the event threads due on this tick, lowest numbered first,
+// called by the 1 ms interrupt
+// Inputs:  none
+// Outputs: none
+void RunEvents(void){ uint32_t due,i;
+  EventTick++;
+  if(EventTick == HyperPeriod){
+    EventTick = 0;
+  }
+  due = ((uint32_t)Due[EventTick])<<24;
+  while(due){
+    i = __clz(due);
+    due &= ~(0x80000000>>i);
+    Events[i].Task();
+  }
+}
+
+//******** OS_AddPeriodicEventThread ***************
+// Add one background periodic event thread
+// Inputs: pointer to a void/void event thread function
+//         period given in units of OS_Launch (Lab 3 this will be msec)
+// Outputs: 1 if successful, 0 if this thread cannot be added
+// The hyperperiod with this thread must be at most HYPERMAX msec
+int OS_AddPeriodicEventThread(void(*thread)(void), uint32_t period){
+  uint32_t hyper;
+  if((NumEvents == NUMEVENTS) || (period == 0)){
+    return 0;
+  }
+  hyper = HyperPeriod/Gcd(HyperPeriod, period)*period;
+  if(hyper > HYPERMAX){
+    return 0;            // Due is too short
+  }
+  HyperPeriod = hyper;
+  Events[NumEvents].Task = thread;
+  Events[NumEvents].Period = period;
+  NumEvents++;
+  return 1;
+}
+
+//******** OS_PeriodicEventPeak ***************
+// Most event threads run on one 1 ms tick by the phases chosen
+// Inputs:  none
+// Outputs: number of event threads, 0 if there are none
+uint32_t OS_PeriodicEventPeak(void){
+  return EventPeak;
+}
@@ -0,0 +1,24 @@
+// events.h
+// Runs on LM4F120/TM4C123/MSP432, and on Linux in ../HostPort
+// The two calls the kernel makes into events.c; OS_AddPeriodicEventThread
+// and OS_PeriodicEventPeak are in os.h
+
+#ifndef __EVENTS_H
+#define __EVENTS_H  1
+#include <stdint.h>
+
+// ******** EventSchedule ************
+// Give each event thread a phase and build the table of the threads
+// due on each tick; call in OS_Launch, after the last
+// OS_AddPeriodicEventThread
+// Inputs:  none
+// Outputs: none
+void EventSchedule(void);
+
+// ******** RunEvents ************
+// Run the event threads due on this tick, call from the 1 ms interrupt
+// Inputs:  none
+// Outputs: none
+void RunEvents(void);
+
+#endif
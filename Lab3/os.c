@@ -9,21 +9,25 @@
 #include "os.h"
 #include "CortexM.h"
 #include "BSP.h"
+#include "events.h"
 #include "../inc/tm4c123gh6pm.h"
 
 // function definitions in osasm.s
 void StartOS(void);
+void ContextSwitch(void);    // trigger PendSV
 
 #define NUMTHREADS  8        // maximum number of threads
 #define NUMPERIODIC 2        // maximum number of periodic threads
 #define STACKSIZE   100      // number of 32-bit words in stack per thread
+#define NUMPRIORITIES 32     // priorities 0 (highest) to 31, one bit each in ReadyBits
 struct tcb{
   int32_t *sp;       // pointer to stack (valid for threads not running
-  struct tcb *next;  // linked-list pointer
+  struct tcb *next;  // circular list of ready threads with the same priority
 //*FILL THIS IN****
 		//---MyCode---
 	int32_t *blocked;
-	uint32_t sleep;
+	uint32_t sleep;		// while sleeping, msec to wake up after the thread before it in sleepPt list
+	struct tcb *sleepNext;	// next sleeping thread, in order of wake up time
 	uint32_t	priority;
 	//---MyCodeEnd---
 };
@@ -32,6 +36,72 @@ tcbType tcbs[NUMTHREADS];
 tcbType *RunPt;
 int32_t Stacks[NUMTHREADS][STACKSIZE];
 void static runperiodicevents(void);
+void Scheduler(void);
+// only threads that are not blocked and not sleeping are in a ready list
+tcbType *ReadyPt[NUMPRIORITIES]; // ready thread at this priority that ran last, 0 if none
+uint32_t ReadyBits;    // bit 31-p is set if ReadyPt[p] is nonzero, so __clz finds the highest
+// sleeping threads are in a delta list, so only the first one is counted down
+tcbType *SleepPt;      // thread that wakes up first, 0 if no thread is sleeping
+
+// ******** ReadyInsert ************
+// Make a thread ready, called with interrupts disabled
+// It runs after the other ready threads of its priority have had a turn
+// Inputs:  pointer to a thread that is not in a ready list
+// Outputs: none
+void static ReadyInsert(tcbType *thread){
+  uint32_t p = thread->priority;
+  if(ReadyPt[p]){
+    thread->next = ReadyPt[p]->next;
+    ReadyPt[p]->next = thread;
+  } else{
+    thread->next = thread;       // only ready thread at this priority
+    ReadyBits |= 0x80000000>>p;
+  }
+  ReadyPt[p] = thread;           // last in the round robin order
+}
+
+// ******** ReadyRemove ************
+// Take a thread out of its ready list, called with interrupts disabled
+// The thread keeps its next pointer, so Scheduler continues round robin after it
+// Inputs:  pointer to a thread that is in a ready list
+// Outputs: none
+void static ReadyRemove(tcbType *thread){
+  uint32_t p = thread->priority;
+  tcbType *pt;
+  if(thread->next == thread){    // last ready thread at this priority
+    ReadyPt[p] = 0;
+    ReadyBits &= ~(0x80000000>>p);
+    return;
+  }
+  pt = thread;
+  while(pt->next != thread){     // only threads with this priority are searched
+    pt = pt->next;
+  }
+  pt->next = thread->next;
+  if(ReadyPt[p] == thread){
+    ReadyPt[p] = pt;             // thread after this one runs next
+  }
+}
+
+// ******** SleepInsert ************
+// Put a thread into the sleeping list, called with interrupts disabled
+// The list is kept in wake up order, each sleep field holding the
+// msec after the thread before it, so only the first is counted down
+// Inputs:  pointer to a thread that is not ready, msec to sleep (at least 1)
+// Outputs: none
+void static SleepInsert(tcbType *thread, uint32_t time){
+  tcbType **linkPt = &SleepPt;
+  while((*linkPt) && ((*linkPt)->sleep <= time)){
+    time = time - (*linkPt)->sleep;
+    linkPt = &((*linkPt)->sleepNext);
+  }
+  thread->sleep = time;
+  thread->sleepNext = *linkPt;
+  if(*linkPt){
+    (*linkPt)->sleep -= time;    // thread after wakes relative to this one
+  }
+  *linkPt = thread;
+}
 
 // ******** OS_Init ************
 // Initialize operating system, disable interrupts
@@ -87,15 +157,8 @@ int OS_AddThreads(void(*thread0)(void), uint32_t p0,
 // **similar to Lab 3. initialize priority field****
 												//-----My Code-----
 	int32_t status;
+	int i;
 	status = StartCritical();
-	tcbs[0].next = &tcbs[1];	//0 points to 1
-	tcbs[1].next = &tcbs[2];	//1 points to 2
-	tcbs[2].next = &tcbs[3];	//2 points to 3
-	tcbs[3].next = &tcbs[4];	//3 points to 4
-	tcbs[4].next = &tcbs[5];	//4 points to 5
-	tcbs[5].next = &tcbs[6];	//5 points to 6
-	tcbs[6].next = &tcbs[7];	//6 points to 7
-	tcbs[7].next = &tcbs[0];	//7 points to 0
 										
 	SetInitialStack(0); Stacks[0][STACKSIZE-2] = (int32_t)(thread0);
 	SetInitialStack(1); Stacks[1][STACKSIZE-2] = (int32_t)(thread1);
@@ -115,7 +178,17 @@ int OS_AddThreads(void(*thread0)(void), uint32_t p0,
 	tcbs[6].blocked = 0;		tcbs[6].sleep = 0;		tcbs[6].priority = p6;
 	tcbs[7].blocked = 0;		tcbs[7].sleep = 0;		tcbs[7].priority = p7;
 	
-	RunPt = &tcbs[0];
+	ReadyBits = 0;
+	SleepPt = 0;
+	for(i=0; i<NUMPRIORITIES; i++){
+		ReadyPt[i] = 0;
+	}
+	for(i=0; i<NUMTHREADS; i++){
+		if(tcbs[i].priority >= NUMPRIORITIES){
+			tcbs[i].priority = NUMPRIORITIES-1;	//lowest priority
+		}
+		ReadyInsert(&tcbs[i]);	//all ready, round robin in the order added
+	}
 	EndCritical(status);
 //-----End My Code-----
  
@@ -123,15 +196,21 @@ int OS_AddThreads(void(*thread0)(void), uint32_t p0,
 }
 
 
-void static runperiodicevents(void){
-// ****IMPLEMENT THIS****
-// **DECREMENT SLEEP COUNTERS
+// runs every ms
+// only the first sleeping thread is counted down, threads after
+// it with a zero sleep field wake up at the same time
 // In Lab 4, handle periodic events in RealTimeEvents
-  	int32_t i;
-	for(i=0; i<NUMTHREADS; i++){
-		if((tcbs[i].sleep) > 0){
-			tcbs[i].sleep--;
-		}
+void static runperiodicevents(void){
+	tcbType *pt;
+	RunEvents();
+	if(SleepPt == 0){
+		return;
+	}
+	SleepPt->sleep--;
+	while(SleepPt && (SleepPt->sleep == 0)){
+		pt = SleepPt;
+		SleepPt = pt->sleepNext;
+		ReadyInsert(pt);	// done sleeping
 	}
 }
 
@@ -143,31 +222,30 @@ void static runperiodicevents(void){
 void OS_Launch(uint32_t theTimeSlice){
   STCTRL = 0;                  // disable SysTick during setup
   STCURRENT = 0;               // any write to current clears it
-  SYSPRI3 =(SYSPRI3&0x00FFFFFF)|0xE0000000; // priority 7
+  SYSPRI3 =(SYSPRI3&0x0000FFFF)|0xE0E00000; // priority 7, SysTick and PendSV
   STRELOAD = theTimeSlice - 1; // reload value
+  Scheduler();                 // RunPt points to highest priority thread
+  EventSchedule();             // phases and table of the event threads
   STCTRL = 0x00000007;         // enable, core clock and interrupt arm
 	BSP_PeriodicTask_Init(&runperiodicevents,1000,1);			//to run the sleep timer
   StartOS();                   // start on the first task
 }
+// runs at the end of each time slice
+// the switch itself is done in PendSV_Handler
+void SysTick_Handler(void){
+  ContextSwitch();
+}
 // runs every ms
-void Scheduler(void){      // every time slice
-// ****IMPLEMENT THIS****
-// look at all threads in TCB list choose
-// highest priority thread not blocked and not sleeping 
+// choose the highest priority thread not blocked and not sleeping
 // If there are multiple highest priority (not blocked, not sleeping) run these round robin
-uint32_t max = 255;
-	tcbType *pt;
-	tcbType *bestPt;
-	pt = RunPt;
-	
-	do{
-		pt = pt->next;
-		if((pt->priority < max) && ((pt->blocked) == 0) && ((pt->sleep) == 0)){
-		bestPt = pt;
-			max = pt -> priority;
-		}
-	} while(RunPt != pt);			// look at all the possible threads
-	RunPt = bestPt;
+// Blocked and sleeping threads are not in the ready lists, so the time
+// to choose does not depend on the number of threads
+// At least one thread must always be ready (e.g., Task7 never blocks or sleeps)
+void Scheduler(void){      // every time slice
+  tcbType *pt;
+  pt = ReadyPt[__clz(ReadyBits)]->next; // next ready thread at highest priority
+  ReadyPt[pt->priority] = pt;
+  RunPt = pt;
 }
 
 //******** OS_Suspend ***************
@@ -175,10 +253,10 @@ uint32_t max = 255;
 // Inputs: none
 // Outputs: none
 // Will be run again depending on sleep/block status
+// SysTick is not touched, so time slices stay on the same period
+// and the next thread runs for the rest of this one
 void OS_Suspend(void){
-  STCURRENT = 0;        // any write to current clears it
-  INTCTRL = 0x04000000; // trigger SysTick
-// next thread gets a full time slice
+  ContextSwitch();      // trigger PendSV
 }
 
 // ******** OS_Sleep ************
@@ -191,8 +269,13 @@ void OS_Sleep(uint32_t sleepTime){
 // set sleep parameter in TCB, same as Lab 3
 // suspend, stops running
 		//---MyCode---
-	RunPt->sleep = sleepTime;
-	OS_Suspend();
+	DisableInterrupts();
+	if(sleepTime){
+		ReadyRemove(RunPt);
+		SleepInsert(RunPt, sleepTime);	// ready again when it reaches the front and counts down
+	}
+	ContextSwitch();	// PendSV runs as soon as interrupts are enabled, no tick can come first
+	EnableInterrupts();
 	//---MyCodeEnd---
 
 }
@@ -224,8 +307,8 @@ void OS_Wait(int32_t *semaPt){
 	(*semaPt) = (*semaPt) - 1;
 	if((*semaPt) < 0){
 		RunPt -> blocked = semaPt; 
-		EnableInterrupts();
-		OS_Suspend();
+		ReadyRemove(RunPt);
+		ContextSwitch();	// switches at EnableInterrupts
 	}
 	EnableInterrupts();
 //-----My Code End-----
@@ -245,11 +328,13 @@ void OS_Signal(int32_t *semaPt){
 	DisableInterrupts();
 	(*semaPt) = (*semaPt) + 1;
 	if((*semaPt) <= 0){
-		pt = RunPt->next;				//search for a thread blocked on this semaphore
-		while(pt->blocked != semaPt){
-			pt = pt->next;
-		}
-		pt->blocked = 0;
+		for(pt = &tcbs[0]; pt < &tcbs[NUMTHREADS]; pt++){	//search for a thread blocked on this semaphore
+			if(pt->blocked == semaPt){
+				pt->blocked = 0;
+				ReadyInsert(pt);
+				break;
+			}
+		}									//none found: initialized negative, nothing to wake
 	}
 	EnableInterrupts();
 //-----My Code End-----
@@ -60,8 +60,18 @@ int OS_AddThreads(void(*thread0)(void),
 // These threads cannot spin, block, loop, sleep, or kill
 // These threads can call OS_Signal
 // In Lab 3 this will be called exactly twice
+// Phases are chosen at OS_Launch to spread the event threads over
+// the ticks; the least common multiple of the periods must be at
+// most 1000 msec
 int OS_AddPeriodicEventThread(void(*thread)(void), uint32_t period);
 
+//******** OS_PeriodicEventPeak ***************
+// Most event threads run on one 1 ms tick by the phases chosen
+// Inputs:  none
+// Outputs: number of event threads, 0 if there are none
+// Valid after OS_Launch
+uint32_t OS_PeriodicEventPeak(void);
+
 //******** OS_Launch ***************
 // Start the scheduler, enable interrupts
 // Inputs: number of clock cycles for each time slice
@@ -14,11 +14,14 @@
 
         EXTERN  RunPt            ; currently running thread
         EXPORT  StartOS
-        EXPORT  SysTick_Handler
+        EXPORT  ContextSwitch
         IMPORT  Scheduler
+        EXPORT  PendSV_Handler
 
-
-SysTick_Handler                ; 1) Saves R0-R3,R12,LR,PC,PSR
+; All thread switches are done here, at the lowest priority.  SysTick,
+; OS_Suspend and the blocking calls only trigger PendSV, so a yield
+; does not restart the time slice.
+PendSV_Handler                 ; 1) Saves R0-R3,R12,LR,PC,PSR
     CPSID   I                  ; 2) Prevent interrupt during switch
    ;YOU IMPLEMENT THIS (same as Lab 2)
 	PUSH	{R4-R11}			; 3)
@@ -34,6 +37,16 @@ SysTick_Handler                ; 1) Saves R0-R3,R12,LR,PC,PSR
     CPSIE   I                  ; 9) tasks run with interrupts enabled
     BX      LR                 ; 10) restore R0-R3,R12,LR,PC,PSR
 
+; ********ContextSwitch************
+; Trigger PendSV to switch threads as soon as interrupts are enabled
+; Inputs: none
+; Outputs: none
+ContextSwitch
+    LDR     R0, =0xE000ED04    ; Interrupt control state register
+    LDR     R1, =0x10000000
+    STR     R1, [R0]           ; trigger PendSV
+    BX      LR
+
 StartOS
    ;YOU IMPLEMENT THIS (same as Lab 2)
 	
@@ -35,7 +35,7 @@ void soundTask(void){
 //        duration in ms
 //        volume 10 to 256
 // Output: none
-// ISR will interrupt at freq Hz, priority 6
+// ISR will interrupt at freq Hz, priority 0, which the OS never masks (KERNELPRI)
 // ISR will toggle the buzzer on/off
 // ISR will occur (duration*freq/1000) times
 // No sound if (duration*freq)<2000 (must toggle at least twice)
@@ -45,7 +45,7 @@ void Sound_PlayTone(uint32_t freq, uint16_t volume, uint32_t duration) {
   soundVolume = volume;
   soundDuration = (duration*freq)/1000;
   if(soundDuration<2) return; // not possible
-  BSP_PeriodicTask_InitC(&soundTask, freq, 6);
+  BSP_PeriodicTask_InitC(&soundTask, freq, 0);
 }
 // Frequency of notes in Hz 
 #define E1  1319 
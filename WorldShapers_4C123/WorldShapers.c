@@ -43,10 +43,53 @@ int32_t NewData;     // set by real-time tasks to signal graphics update
 int32_t RunGame;     // set at 30 Hz
 int32_t Button;      // set on button touch
 int32_t CreateEnemy; // Set at 10 Hz
-int32_t Mutex;
+MutexType Mutex;
 int32_t IntermissionFlag=1;
 #define FIX 64    // 1/64 pixels
 
+// wake up latency, bus cycles from OS_Signal in the interrupt to the
+// signaled task running again, view GameLatency and ButtonLatency in the debugger
+#ifndef DWT_CYCCNT       // HostPort defines these from its clock
+#define DEMCR      (*((volatile uint32_t *)0xE000EDFC))
+#define DWT_CTRL   (*((volatile uint32_t *)0xE0001000))
+#define DWT_CYCCNT (*((volatile uint32_t *)0xE0001004))
+#endif
+extern uint32_t PeriodicSignalTime0; // in os.c, DWT_CYCCNT when RunGame was signaled
+extern uint32_t EdgeSignalTime;      // in os.c, DWT_CYCCNT when Button was signaled
+                                     // both need SIGNALTIMES 1 in os.c, the default
+struct latency{
+  uint32_t Min;   // shortest, bus cycles
+  uint32_t Max;   // longest, bus cycles
+  uint32_t Sum;   // Sum/Num is the average
+  uint32_t Num;   // number of times measured
+};
+typedef struct latency latencyType;
+latencyType GameLatency;
+latencyType ButtonLatency;
+void Latency_Init(latencyType *l){
+  l->Min = 0xFFFFFFFF;
+  l->Max = 0;
+  l->Sum = 0;
+  l->Num = 0;
+}
+// call right after the wait returns, only if the task had to block
+void Latency_Record(latencyType *l, uint32_t signalTime){
+  uint32_t cycles = DWT_CYCCNT - signalTime;
+  if(cycles < l->Min) l->Min = cycles;
+  if(cycles > l->Max) l->Max = cycles;
+  l->Sum = l->Sum + cycles;
+  l->Num++;
+}
+
+// CPU use of each thread over about a second, taken by GameTask every
+// 30 frames, view CpuStats and IsrPercent in the debugger
+// Task tells GameTask, ButtonTask, EnemyCreateTask and the kernel threads apart
+#define NUMSTATS 20
+ThreadStatsType CpuStats[NUMSTATS];
+int NumStats;          // entries of CpuStats filled
+uint32_t IsrPercent;   // time in interrupts, 0.01%
+uint32_t StatsFrames;  // frames since CpuStats was taken
+
 /*  ****************************************
     *x=0,y=0                      x=127,y=0*
     *                                      *
@@ -178,6 +221,7 @@ void MoveLand(void){
 void CreateLand(uint32_t duration, uint32_t max, int32_t city){
   uint32_t i; uint32_t Rnd,change,Range; int32_t t;
   Landscape[0] = 5; Range = 5;
+  Rnd = 5;         // city height until the first block, was used uninitialized
   for(i=1; i<MAXTERRAIN-32; i++){
     if(city){
       if((i%Range)==0){
@@ -263,7 +307,7 @@ void DrawLand(uint16_t color, uint16_t bgcolor){
 }
 
 void DrawSprites(void){int i;
-	OS_Wait(&Mutex);
+	OS_LockMutex(&Mutex);
   for(i=0; i<NUMSPRITES; i++){
     if(Things[i].life){ 
       BSP_LCD_DrawBitmap(Things[i].x, Things[i].y, Things[i].ImagePt[Things[i].AnimationIndex], Things[i].w,Things[i].h);
@@ -274,7 +318,7 @@ void DrawSprites(void){int i;
       }
     }
   }
-	OS_Signal(&Mutex);
+	OS_UnlockMutex(&Mutex);
 }
 void MissileHitsShip(void){ // check for enemy missiles hitting player ship
   uint32_t i,d;
@@ -388,7 +432,7 @@ void RocketHitsEnemy(void){ // check for rockets hitting enemies
 }        
 
 void MoveSprites(void){int i;
-	OS_Wait(&Mutex);
+	OS_LockMutex(&Mutex);
   for(i=0; i<NUMSPRITES; i++){
     if(Things[i].life){
       Things[i].fx = Things[i].fx+Things[i].vx;
@@ -406,7 +450,7 @@ void MoveSprites(void){int i;
       }
     }
   }
-	OS_Signal(&Mutex);
+	OS_UnlockMutex(&Mutex);
 }
 void CreateSprite(int i, 
   const unsigned short *livePt, const unsigned short *livePt2,
@@ -415,7 +459,7 @@ void CreateSprite(int i,
   short initx, short inity,
   short width, unsigned height,
   short initvx, short initvy, int alive){
-	OS_Wait(&Mutex);
+	OS_LockMutex(&Mutex);
   Things[i].ImagePt[0] = livePt;
   Things[i].ImagePt[1] = livePt2;
   Things[i].AnimationIndex = 0;
@@ -431,7 +475,7 @@ void CreateSprite(int i,
   Things[i].vx = initvx;
   Things[i].vy = initvy;
   Things[i].life  = alive;    
-	OS_Signal(&Mutex);
+	OS_UnlockMutex(&Mutex);
 }
 
 int abs(int x){
@@ -617,11 +661,35 @@ void Intermission(uint32_t delay10ms, int32_t level){
   IntermissionFlag=1;            // game engine restarts, sounds continue
   if(RunGame>0) OS_InitSemaphore(&RunGame,0);  // don't queue up flags
 }
+struct missile{
+  short x,y;   // where it starts
+  short vx,vy; // motion, change in 1/FIX pixels per video frame
+};
+struct missile MissileBuf[8];
+QueueType Missiles;   // fired by EnemyMove, created by GameTask
+//------------FireMissiles creates the missiles the enemies fired -------
+// called by GameTask each frame
+void FireMissiles(void){ uint32_t j;
+  struct missile m;
+  while(OS_Queue_TryGet(&Missiles, &m) == 0){
+    j = FindFreeEMissile();
+    if(j){
+      CreateSprite(j,missile0,missile1,10,missile3,m.x,m.y,5,5,m.vx,m.vy,1);
+    }
+  }
+}
 void GameTask(void){ // runs at 30 Hz
-  uint16_t x,y; uint8_t button;
+  uint16_t x,y; uint8_t button; int32_t blocked;
   Intermission(300, -1);
   while(Things[SHIP].life){
+    blocked = (RunGame <= 0); // otherwise the signal came before the wait
     OS_Wait(&RunGame);
+    if(blocked) Latency_Record(&GameLatency, PeriodicSignalTime0);
+    StatsFrames++;
+    if(StatsFrames == 30){
+      StatsFrames = 0;
+      NumStats = OS_GetStats(CpuStats, NUMSTATS, &IsrPercent);
+    }
     if(IntermissionFlag){
       TExaS_Task0();     // records system time in array, toggles virtual logic analyzer
       BSP_Joystick_Input(&x,&y,&button);
@@ -658,6 +726,7 @@ void GameTask(void){ // runs at 30 Hz
           Things[SHIP].vx = -2*LandDuration;  // move left
         }
       }
+      FireMissiles();
       MoveSprites();
       MoveLand(); // terrain movement
       DrawLand(Levels[CurrentLevel].Landcolor, LCD_BLACK);
@@ -683,13 +752,77 @@ void GameTask(void){ // runs at 30 Hz
   Intermission(300, 6);
   while(1);
 }
-//------------EnemyTask controls the enemies -------
-// multiple threads each running this same program
+//------------EnemyMove controls the enemies -------
+// one periodic timer for each enemy sprite, runs every 100 ms
 // AI of enemy
-void EnemyTask(void){ uint32_t me; uint32_t t,j,initY,ok,trys;
+// the callback must not block, and CreateSprite can wait for the
+// Mutex, so the missiles it fires go in a queue for GameTask
+TimerType EnemyTimers[ENEMYMAX-ENEMYMIN+1];
+void EnemyMove(TimerType *timerPt){ uint32_t me; uint32_t t,j; int dx,dy;
+  struct missile m;
+  me = ENEMYMIN+(timerPt-EnemyTimers);
+  if(Things[me].life == 0){
+    OS_Timer_Stop(timerPt); // destroyed
+    return;
+  }
+  if(CurrentLevel>1){ // move towards ship
+    dx = Things[SHIP].fx - Things[me].fx;
+			if(dx>0) dx=0; // can't back up
+    dy = Things[SHIP].fy-8*FIX - Things[me].fy;
+    while((dx*dx+dy*dy)>(EnemySpeed*EnemySpeed)){
+      dx = (3*dx)/4;
+      dy = (3*dy)/4;
+    }
+    Things[me].vx = dx;
+    Things[me].vy = dy+(((FIX/2)*Random())/256 - FIX/4); // wiggles around
+  }else{
+    Things[me].vy = ((FIX)*Random())/256 - FIX/2; // wiggles around
+  }
+  t=0; // closest land to this enemy
+  if(Things[me].x<=20){
+    j = 0;
+  }else{
+    j = Things[me].x-20;
+  }
+  while(j <= (Things[me].x+Things[me].w)){
+    if(Landscape[j] > t){
+      t = Landscape[j];  // max land in front of enemy
+    }
+    j++;
+  }
+  t = SCREENHEIGHT - t ; // largest y allowed
+  if(Things[me].y >= t-5){
+    Things[me].vy = -FIX; // move up fast
+  }else if(Things[me].y >= t-10){
+    Things[me].vy = -FIX/2; // move up slower
+  }
+  if(Random16() < Levels[CurrentLevel].EnemyMissileThreshold){ // 0 to 65535
+    int MissileSpeed = Levels[CurrentLevel].EnemyMissileSpeed;
+    m.x = Things[me].x-2;
+    m.y = Things[me].y-2;
+    if(CurrentLevel<2){
+      m.vx = -MissileSpeed;
+      m.vy = 0;
+    }else{
+      dx = Things[SHIP].fx - Things[me].fx;
+      dy = Things[SHIP].fy-8*FIX - Things[me].fy;
+      while((dx*dx+dy*dy)>(MissileSpeed*MissileSpeed)){
+        dx = (3*dx)/4;
+        dy = (3*dy)/4;
+      }
+      m.vx = dx;
+      m.vy = dy;
+    }
+    OS_Queue_TryPut(&Missiles, &m); // dropped if full, like with no free sprite
+  }
+}
+//------------EnemyCreate places a new enemy -------
+// on the right of the screen, away from the other enemies,
+// then its timer moves it every 100 ms
+void EnemyCreate(void){ uint32_t me; uint32_t t,j,initY,ok,trys;
   me = FindFreeEnemy(); 
   if(me==0){
-		OS_Kill(); // no sprites left to use
+		return; // no sprites left to use
 	}
   t = 0;     // landscape 0 means bottom of screen     
   for(j=SCREENWIDTH-20; j<SCREENWIDTH;j++){
@@ -711,7 +844,7 @@ void EnemyTask(void){ uint32_t me; uint32_t t,j,initY,ok,trys;
       }
     }
     trys++;
-	  if(trys==40) OS_Kill(); // no room on screen
+	  if(trys==40) return; // no room on screen
   }
   if(Random() > 64){
     if(((CurrentLevel==0)&&(Score >= 500))||(CurrentLevel>3)){
@@ -722,58 +855,7 @@ void EnemyTask(void){ uint32_t me; uint32_t t,j,initY,ok,trys;
   }else{
     CreateSprite(me,cute0,cute1,10,cute3,118,initY,11,11,-CuteSpeed,0,Levels[CurrentLevel].EnemyLife);
   }
-  while(Things[me].life){ int dx,dy;
-    OS_Sleep(100);
-    if(CurrentLevel>1){ // move towards ship
-      dx = Things[SHIP].fx - Things[me].fx;
-			if(dx>0) dx=0; // can't back up
-      dy = Things[SHIP].fy-8*FIX - Things[me].fy;
-      while((dx*dx+dy*dy)>(EnemySpeed*EnemySpeed)){
-        dx = (3*dx)/4;
-        dy = (3*dy)/4;
-      }
-      Things[me].vx = dx;
-      Things[me].vy = dy+(((FIX/2)*Random())/256 - FIX/4); // wiggles around
-    }else{
-      Things[me].vy = ((FIX)*Random())/256 - FIX/2; // wiggles around
-    }
-    t=0; // closest land to this enemy
-    if(Things[me].x<=20){
-      j = 0;
-    }else{
-      j = Things[me].x-20;
-    }
-    while(j <= (Things[me].x+Things[me].w)){
-      if(Landscape[j] > t){
-        t = Landscape[j];  // max land in front of enemy
-      }
-      j++;
-    }
-    t = SCREENHEIGHT - t ; // largest y allowed
-    if(Things[me].y >= t-5){
-      Things[me].vy = -FIX; // move up fast
-    }else if(Things[me].y >= t-10){
-      Things[me].vy = -FIX/2; // move up slower
-    }
-    if(Random16() < Levels[CurrentLevel].EnemyMissileThreshold){ // 0 to 65535
-      j = FindFreeEMissile();
-      if(j){
-        int MissileSpeed = Levels[CurrentLevel].EnemyMissileSpeed;
-        if(CurrentLevel<2){
-          CreateSprite(j,missile0,missile1,10,missile3,Things[me].x-2,Things[me].y-2,5,5,-MissileSpeed,0,1);
-        }else{ int dx,dy;
-          dx = Things[SHIP].fx - Things[me].fx;
-          dy = Things[SHIP].fy-8*FIX - Things[me].fy;
-          while((dx*dx+dy*dy)>(MissileSpeed*MissileSpeed)){
-            dx = (3*dx)/4;
-            dy = (3*dy)/4;
-          }
-          CreateSprite(j,missile0,missile1,10,missile3,Things[me].x-2,Things[me].y-2,5,5,dx,dy,1); 
-        }
-      }
-    }
-  }
-  OS_Kill();
+  OS_Timer_Start(&EnemyTimers[me-ENEMYMIN], 100);
 }
 //------------EnemyCreateTask creates new enemies randomly -------
 void EnemyCreateTask(void){
@@ -782,7 +864,7 @@ void EnemyCreateTask(void){
     if(IntermissionFlag){  // halt game during intermissions
       TExaS_Task1();       // records system time in array, toggles virtual logic analyzer
       if(Random16() < Levels[CurrentLevel].EnemyThreshold){ // 0 to 65535
-        OS_AddThread(&EnemyTask,0); // thread will create itself
+        EnemyCreate();     // its timer moves it, no thread
       }
     }
   }
@@ -791,38 +873,27 @@ void EnemyCreateTask(void){
 // *********ButtonTask*********
 // Main thread scheduled by OS priority scheduler
 // real-time task, signaled on touch
-//   with bouncing, may also be called on release
-// checks the switches, creates player rockets
+//   the kernel debounces button1, so each signal is one press
+// creates player rockets
 // Inputs:  none
 // Outputs: none
 void ButtonTask(void){uint32_t i;
-  uint8_t current;
-	OS_InitSemaphore(&Button,0); // signaled on touch button1
+  int32_t blocked;
   while(1){
+    blocked = (Button <= 0);
 		OS_Wait(&Button);      // OS signals on touch
+    if(blocked) Latency_Record(&ButtonLatency, EdgeSignalTime);
     TExaS_Task3();         // records system time in array, toggles virtual logic analyzer
-    OS_Sleep(10);          // debounce the switches
-    current = BSP_Button1_Input();
-    if(current == 0){     // Button1 was pressed 
-      i = FindFreeRocket();
-      if(i){
-        Sound_Shoot();
-        if(Score > 1) Score--;
-        CreateSprite(i,rocket0,rocket1,10,rocket3,Things[SHIP].x+8,Things[SHIP].y-5,8,3,RocketSpeed,0,1);
-      }
+    i = FindFreeRocket();
+    if(i){
+      Sound_Shoot();
+      if(Score > 1) Score--;
+      CreateSprite(i,rocket0,rocket1,10,rocket3,Things[SHIP].x+8,Things[SHIP].y-5,8,3,RocketSpeed,0,1);
     }
-		OS_EdgeTrigger_Restart();
   }
 }
 
-int Freetime;
-void IdleTask(void){ // dummy task
-  Freetime = 0;      // this task cannot block, sleep or kill
-  while(1){
-    Freetime++; 
-  }
-}
-int main(void){uint16_t x,y; uint8_t button;
+int main(void){uint16_t x,y; uint8_t button; uint32_t i;
   DisableInterrupts();
   BSP_Clock_InitFastest();
   BSP_Joystick_Init();
@@ -838,16 +909,25 @@ int main(void){uint16_t x,y; uint8_t button;
   OS_Init();
   OS_PeriodTrigger0_Init(&RunGame,33); // timing engine for game
   OS_PeriodTrigger1_Init(&CreateEnemy,100); // create enemies 10 times a second
-	OS_EdgeTrigger_Init(&Button, 3);     // effect of button touch
+  OS_InitSemaphore(&Button,0);      // signaled on touch button1
+  OS_EdgeSema_Init(OS_PIN('D',6), EDGE_FALLING, 10, &Button, 3); // effect of button touch, 10 ms debounce
   TExaS_Init(LOGICANALYZER,BSP_Clock_GetFreq());
+  DEMCR |= 0x01000000;    // enable trace, needed for DWT
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= 0x00000001; // enable cycle counter, for wake up latency
+  Latency_Init(&GameLatency);
+  Latency_Init(&ButtonLatency);
  // Sound_EyesOfTexas();
   OS_InitSemaphore(&RunGame,0);     // signaled by timer to run engine
-  OS_InitSemaphore(&Mutex,1);       // access to sprites
+  OS_InitMutex(&Mutex);            // access to sprites
   OS_InitSemaphore(&CreateEnemy,0); // signaled by time to create enemies
+  OS_Queue_Init(&Missiles, MissileBuf, sizeof(struct missile), 8);
+  for(i=0; i<=ENEMYMAX-ENEMYMIN; i++){
+    OS_Timer_Create(&EnemyTimers[i], &EnemyMove, 100);
+  }
 	OS_AddThread(&GameTask,0);
   OS_AddThread(&ButtonTask,0);   // high priority, signaled on button touch
   OS_AddThread(&EnemyCreateTask,2);
-  OS_AddThread(&IdleTask,7);     // lowest priority, dummy task
   CreateSprite(SHIP,ship0,ship1,2,ship3,0,DesiredPlace,18,13,0,0,10);
   OS_Launch(BSP_Clock_GetFreq()/THREADFREQ); // doesn't return, interrupts enabled in here
   while(1){ // does not get here
@@ -11,28 +11,706 @@
 #include "CortexM.h"
 #include "BSP.h"
 #include "../inc/tm4c123gh6pm.h"
+#ifndef DWT_CYCCNT
+#define DEMCR      (*((volatile uint32_t *)0xE000EDFC))
+#define DWT_CTRL   (*((volatile uint32_t *)0xE0001000))
+#define DWT_CYCCNT (*((volatile uint32_t *)0xE0001004))
+#endif
 
 // function definitions in osasm.s
 void StartOS(void);
+void ContextSwitch(void);    // trigger PendSV
+uint32_t SetBasePri(uint32_t basepri); // returns the BASEPRI it replaced
 
+#if (KERNELPRI < 1) || (KERNELPRI > 7)
+#error KERNELPRI must be 1 to 7, BASEPRI 0 masks nothing
+#endif
+// Kernel critical sections set BASEPRI, not the I bit, so they hold
+// pending only the interrupts of priority KERNELPRI to 7, those that
+// may call the OS; interrupts of priority 0 to KERNELPRI-1 run on time
+#define KERNELMASK (KERNELPRI<<5)
+uint32_t const KernelMask = KERNELMASK; // PendSV_Handler masks with it around Scheduler
+#ifndef MASKSTATS
+#define MASKSTATS   0        // 1 means record the longest time the kernel masks interrupts, for OS_MaskStats
+#endif
+#if MASKSTATS
+uint32_t static MaskEnter(uint32_t line);
+void static MaskLeave(uint32_t basepri, uint32_t line);
+#define MaskInterrupts()   MaskEnter(__LINE__)
+#define UnmaskInterrupts() MaskLeave(0, __LINE__)
+#define StartMask()        MaskEnter(__LINE__)
+#define EndMask(sr)        MaskLeave(sr, __LINE__)
+#else
+#define MaskInterrupts()   SetBasePri(KERNELMASK)
+#define UnmaskInterrupts() SetBasePri(0)   // a pending PendSV is taken here
+#define StartMask()        SetBasePri(KERNELMASK) // returns the BASEPRI for EndMask
+#define EndMask(sr)        SetBasePri(sr)
+#endif
+
+#ifndef NUMTHREADS
 #define NUMTHREADS  20       // maximum number of threads
+#endif
 #define NUMPERIODIC 2        // maximum number of periodic threads
-#define STACKSIZE   100      // number of 32-bit words in stack per thread
+#define STACKSIZE   100      // number of 32-bit words in stack of OS_AddThread
+#define STACKMIN    128      // smallest stack in bytes, initial frame plus nested interrupts
+#define STACKPAINT  0xA5A5A5A5 // fills a new stack, words still holding it were never used
+#define STACKCHECK  0        // 1 means check the guard word of each thread switched out
+#define CPUSTATS    1        // 1 means Scheduler adds up the cycles each thread runs, for OS_GetStats
+#ifndef SIGNALTIMES
+#define SIGNALTIMES 1        // 1 means triggers and edges record DWT_CYCCNT when they signal, for wake up latency
+#endif
+#ifndef TRACE
+#define TRACE       1        // 1 means record kernel events in TraceBuf, for OS_TraceDump
+#endif
+#define TRACESIZE   256      // events kept, power of 2, the oldest are written over
+#ifndef STACKPOOL
+#define STACKPOOL (NUMTHREADS*STACKSIZE*4) // bytes shared by all thread stacks, multiple of 8
+#endif
+#define NUMPRIORITIES 32     // priorities 0 (highest) to 31, one bit each in ReadyBits
+#define IDLEPRIORITY (NUMPRIORITIES-1) // only the kernel idle thread, below all others
+#define IDLESTACK   256      // bytes, interrupts are its only stack use
+#define NUMSEMAPHORES (2*NUMTHREADS) // entries for int32_t semaphores with blocked threads, at most half used
+#define NUMTRIGGERS 8        // periodic triggers signaled by RealTimeEvents
+#define NUMEDGES    4        // pins with an edge event
+#ifndef TIMERPRIORITY
+#define TIMERPRIORITY 0      // priority of the thread that runs the OS_Timer callbacks
+#endif
+#define TIMERSTACK  512      // bytes, the callbacks run on it
+#define EDGEDEBOUNCE 10      // msec OS_EdgeTrigger_Init leaves PD6 disarmed after an edge
+#ifndef GPIOPORTS
+#define GPIOPORTS {(volatile uint32_t *)0x40004000, (volatile uint32_t *)0x40005000, \
+                   (volatile uint32_t *)0x40006000, (volatile uint32_t *)0x40007000, \
+                   (volatile uint32_t *)0x40024000, (volatile uint32_t *)0x40025000}
+#endif
+#ifndef TICKLESS
+#define TICKLESS    1        // 1 means program Timer4A for the next wake up, 0 means 1 kHz sleep tick
+#endif
+#ifndef EDFPRIORITY
+#define EDFPRIORITY 4        // priority of the threads from OS_AddEdfThread
+#endif
+#define EDFMAX      10000    // longest EDF period or deadline, msec, so DWT_CYCCNT differences fit in 31 bits
 struct tcb{
   int32_t *sp;       // pointer to stack (valid for threads not running
-  struct tcb *next;  // linked-list pointer
+  struct tcb *next;  // circular list of ready threads with the same priority, or of free TCBs
+  struct tcb *prev;  // the other direction, so a thread leaves its ready list in one step
   uint32_t Id;       // 0 means TCB is free
   int32_t *BlockPt;  // nonzero if blocked on this semaphore
-  uint32_t Sleep;    // nonzero if this thread is sleeping
-  uint32_t Priority; // 0 is highest
+  struct tcb *BlockNext; // circular list of threads blocked on the same semaphore
+  uint32_t Sleep;    // while sleeping, msec to wake up after the thread before it in SleepPt list
+  struct tcb *SleepNext; // next sleeping thread, in order of wake up time
+  uint32_t Priority; // 0 is highest, raised while it holds a mutex a higher thread wants
+  uint32_t BasePriority; // priority given to OS_AddThread
+  struct Mutex *MutexPt; // nonzero if blocked on this mutex
+  struct Mutex *HeldPt;  // mutexes this thread owns, most recently locked first
+  int32_t *StackPt;  // lowest address of its stack in StackPool, the guard word
+  uint32_t StackSize;// bytes in its stack
+  uint32_t EventMask;   // flags it waits for, then the flags that woke it up
+  uint32_t EventOptions;// EVENT_ANY or EVENT_ALL, plus EVENT_CLEAR
+  struct Sema4 *TimeoutPt; // blocked on this semaphore and sleeping, until one wakes it
+                           // up; still set when it runs again if the time ran out
+  uint32_t Period;   // EDF, bus cycles between releases, 0 for a fixed priority thread
+  uint32_t Deadline; // EDF, bus cycles after its release each job must finish by
+  uint32_t Release;  // EDF, DWT_CYCCNT when the current job was released
+  uint32_t Misses;   // EDF, jobs that finished after their deadline
+  void(*Task)(void); // function it was added with, tells threads apart in OS_GetStats
+  uint32_t Cycles;   // bus cycles it ran since the last OS_GetStats, less interrupts
+  uint32_t Switches; // times it was switched in since the last OS_GetStats
+  uint32_t MaxBurst; // most bus cycles it ran without being switched out, same time
 };
 typedef struct tcb tcbType;
 tcbType tcbs[NUMTHREADS];
+tcbType *FreeTcbPt;    // stack of free TCBs linked by next, 0 if all are used
+tcbType static *DeadPt;  // killed thread still on its stack, Scheduler frees it, 0 if none
 tcbType *RunPt;
-int32_t Stacks[NUMTHREADS][STACKSIZE];
+// free space in the stack pool is a list of blocks in address order,
+// each block starts with its size and a link to the next
+struct freeblock{
+  uint32_t Size;           // bytes, multiple of 8
+  struct freeblock *Next;  // free block at a higher address, 0 if last
+};
+int64_t StackPool[STACKPOOL/8]; // 64-bit elements keep stacks 8-byte aligned
+struct freeblock *FreePt;  // lowest free block, 0 if all is used
 void static runperiodicevents(void);
+void static IdleThread(void);
+void Scheduler(void);
 uint32_t NumThread=0;  // number of threads
 uint32_t static ThreadId=0;   // thread Ids are sequential from 1
+uint32_t StackOverflowId;     // Id of the thread that wrote over its guard word
+// only threads that are not blocked and not sleeping are in a ready list
+tcbType *ReadyPt[NUMPRIORITIES]; // ready thread at this priority that ran last, 0 if none
+uint32_t ReadyBits;    // bit 31-p is set if ReadyPt[p] is nonzero, so __clz finds the highest
+// sleeping threads are in a delta list, so only the first one is counted down
+tcbType *SleepPt;      // thread that wakes up first, 0 if no thread is sleeping
+uint32_t static CyclesPerMs;     // bus cycles in 1 msec
+#if CPUSTATS
+// each switch charges the thread switched out with the DWT_CYCCNT cycles
+// since it was switched in, less the cycles spent in interrupts
+uint32_t static SwitchTime;  // DWT_CYCCNT when RunPt was last charged
+uint32_t static Burst;       // bus cycles RunPt has run since it was switched in
+uint32_t static IsrRun;      // bus cycles in interrupts since SwitchTime
+uint32_t static IsrCycles;   // bus cycles in interrupts since the last OS_GetStats
+uint32_t static IsrStart;    // DWT_CYCCNT when the outermost interrupt started
+uint32_t static IsrDepth;    // interrupts between OS_IsrEnter and OS_IsrExit
+uint32_t static StatsTime;   // DWT_CYCCNT at the last OS_GetStats, or OS_Launch
+
+// ******** StatsCharge ************
+// Add the time RunPt ran since SwitchTime to its count,
+// called with interrupts disabled
+// Inputs:  none
+// Outputs: none
+void static StatsCharge(void){
+  uint32_t now = DWT_CYCCNT;
+  uint32_t run = now-SwitchTime-IsrRun;
+  RunPt->Cycles += run;
+  Burst += run;
+  if(Burst > RunPt->MaxBurst){
+    RunPt->MaxBurst = Burst;
+  }
+  SwitchTime = now;
+  IsrRun = 0;
+}
+#endif
+#if TRACE
+// one kernel event, 8 bytes, so recording one is a few stores
+struct traceevent{
+  uint32_t Time;     // DWT_CYCCNT
+  uint8_t Event;     // TRACE_SWITCH to TRACE_ISREXIT, see os.h
+  uint8_t Id;        // low 8 bits of the Id of RunPt, 0 before OS_Launch
+  uint16_t Arg;      // low 16 bits, see os.h
+};
+struct traceevent TraceBuf[TRACESIZE];
+uint32_t TraceCount;   // events recorded, the next one goes in TraceBuf[TraceCount&(TRACESIZE-1)]
+uint32_t TraceOn;      // 0 while OS_TraceDump sends them
+
+// ******** TraceRecord ************
+// Record a kernel event, called with interrupts masked
+// Inputs:  TRACE_SWITCH to TRACE_ISREXIT
+//          what it was done to, see os.h
+// Outputs: none
+void static TraceRecord(uint32_t event, uint32_t arg){
+  struct traceevent *pt;
+  if(TraceOn){
+    pt = &TraceBuf[TraceCount&(TRACESIZE-1)];
+    TraceCount++;
+    pt->Time = DWT_CYCCNT;
+    pt->Event = event;
+    pt->Id = RunPt ? RunPt->Id : 0;
+    pt->Arg = arg;
+  }
+}
+#else
+#define TraceRecord(event,arg)
+#endif
+
+// ******** EdfBefore ************
+// Compare the deadlines of the current jobs of two EDF threads
+// Inputs:  pointers to two EDF threads
+// Outputs: nonzero if the first one is due before the second one
+uint32_t static EdfBefore(tcbType *thread, tcbType *other){
+  return (int32_t)((thread->Release+thread->Deadline)-(other->Release+other->Deadline)) < 0;
+}
+
+// ******** EdfInsert ************
+// Make an EDF thread ready, called with interrupts disabled
+// The ready list of EDFPRIORITY is in deadline order from ReadyPt[EDFPRIORITY]->next,
+// threads from OS_AddThread of that priority are after the EDF threads
+// Jobs with the same deadline run in the order they were released
+// Inputs:  pointer to an EDF thread that is not in a ready list,
+//          with at least one thread in the ready list of EDFPRIORITY
+// Outputs: none
+void static EdfInsert(tcbType *thread){
+  tcbType *pt = ReadyPt[EDFPRIORITY]->next; // earliest deadline
+  while(pt->Period && !EdfBefore(thread, pt)){
+    if(pt == ReadyPt[EDFPRIORITY]){
+      thread->next = pt->next;   // latest deadline, last in the list
+      thread->prev = pt;
+      pt->next->prev = thread;
+      pt->next = thread;
+      ReadyPt[EDFPRIORITY] = thread;
+      return;
+    }
+    pt = pt->next;
+  }
+  thread->next = pt;             // just before the first one due later
+  thread->prev = pt->prev;
+  pt->prev->next = thread;
+  pt->prev = thread;
+}
+
+// ******** ReadyInsert ************
+// Make a thread ready, called with interrupts disabled
+// It runs after the other ready threads of its priority have had a turn,
+// or for an EDF thread, after those whose jobs are due before its job
+// Inputs:  pointer to a thread that is not in a ready list
+// Outputs: none
+void static ReadyInsert(tcbType *thread){
+  uint32_t p = thread->Priority;
+  if(ReadyPt[p] && (p == EDFPRIORITY) && thread->Period){
+    EdfInsert(thread);           // by deadline, not round robin
+    return;
+  }
+  if(ReadyPt[p]){
+    thread->next = ReadyPt[p]->next;
+    thread->prev = ReadyPt[p];
+    ReadyPt[p]->next->prev = thread;
+    ReadyPt[p]->next = thread;
+  } else{
+    thread->next = thread;       // only ready thread at this priority
+    thread->prev = thread;
+    ReadyBits |= 0x80000000>>p;
+  }
+  ReadyPt[p] = thread;           // last in the round robin order
+}
+
+// ******** ReadyRemove ************
+// Take a thread out of its ready list, called with interrupts disabled
+// next is 0 while a live thread is not in a ready list
+// Inputs:  pointer to a thread that is in a ready list
+// Outputs: none
+void static ReadyRemove(tcbType *thread){
+  uint32_t p = thread->Priority;
+  if(thread->next == thread){    // last ready thread at this priority
+    ReadyPt[p] = 0;
+    ReadyBits &= ~(0x80000000>>p);
+    thread->next = 0;
+    return;
+  }
+  thread->prev->next = thread->next;
+  thread->next->prev = thread->prev;
+  if(ReadyPt[p] == thread){
+    ReadyPt[p] = thread->prev;   // thread after this one runs next
+  }
+  thread->next = 0;
+}
+
+#if TICKLESS
+// Timer4A counts down once to the first wake up time, then
+// reloads for the next one; it does not interrupt when no thread sleeps
+uint32_t static SleepArmed;      // msec Timer4A was started with, 0 if stopped
+#define SLEEPMAX 50000           // longest single count, msec (fits 32 bits at 80 MHz)
+
+// ******** SleepTimer_Start ************
+// Start Timer4A to interrupt once after a number of msec
+// Inputs:  time in msec, at least 1
+// Outputs: none
+void static SleepTimer_Start(uint32_t time){
+  if(time > SLEEPMAX){
+    time = SLEEPMAX;             // woken part way, runperiodicevents counts the rest
+  }
+  TIMER4_CTL_R &= ~TIMER_CTL_TAEN; // disable Timer4A while loading
+  TIMER4_TAILR_R = time*CyclesPerMs - 1;
+  TIMER4_ICR_R = TIMER_ICR_TATOCINT;
+  NVIC_UNPEND2_R = 1<<6;         // discard a timeout from the previous count
+  SleepArmed = time;
+  TIMER4_CTL_R |= TIMER_CTL_TAEN;  // counts down once
+}
+
+// ******** SleepTimer_Elapsed ************
+// Whole msec since Timer4A was started
+// Inputs:  none
+// Outputs: msec, 0 if the timer is stopped
+uint32_t static SleepTimer_Elapsed(void){
+  if(SleepArmed == 0){
+    return 0;
+  }
+  if(TIMER4_RIS_R&TIMER_RIS_TATORIS){
+    return SleepArmed;           // timed out, interrupt not yet handled
+  }
+  return (TIMER4_TAILR_R - TIMER4_TAV_R)/CyclesPerMs;
+}
+#endif
+
+// ******** SleepInsert ************
+// Put a thread into the sleeping list, called with interrupts disabled
+// The list is kept in wake up order, each Sleep field holding the
+// msec after the thread before it, so only the first is counted down
+// Inputs:  pointer to a thread that is not ready, msec to sleep (at least 1)
+// Outputs: none
+void static SleepInsert(tcbType *thread, uint32_t time){
+  tcbType **linkPt = &SleepPt;
+#if TICKLESS
+  uint32_t elapsed = SleepTimer_Elapsed();
+  time = time + elapsed;         // deltas are counted from when Timer4A was started
+#endif
+  while((*linkPt) && ((*linkPt)->Sleep <= time)){
+    time = time - (*linkPt)->Sleep;
+    linkPt = &((*linkPt)->SleepNext);
+  }
+  thread->Sleep = time;
+  thread->SleepNext = *linkPt;
+  if(*linkPt){
+    (*linkPt)->Sleep -= time;    // thread after wakes relative to this one
+  }
+  *linkPt = thread;
+#if TICKLESS
+  if(SleepPt == thread){         // wakes before Timer4A would have interrupted
+    thread->Sleep = time - elapsed;
+    SleepTimer_Start(thread->Sleep);
+  }
+#endif
+}
+
+// ******** SleepRemove ************
+// Take a thread out of the sleeping list before its time is up,
+// called with interrupts disabled
+// In TICKLESS mode Timer4A is left running, it interrupts early
+// and runperiodicevents starts it again for the next thread
+// Inputs:  pointer to a thread in the sleeping list
+// Outputs: none
+void static SleepRemove(tcbType *thread){
+  tcbType **linkPt = &SleepPt;
+  while(*linkPt != thread){
+    linkPt = &((*linkPt)->SleepNext);
+  }
+  *linkPt = thread->SleepNext;
+  if(thread->SleepNext){
+    thread->SleepNext->Sleep += thread->Sleep; // wakes at the same time as before
+  }
+}
+
+// ******** WaitInsert ************
+// Add a thread to a wait list, called with interrupts disabled
+// The wait list pointer is to the last thread to wake up, and the
+// last thread links to the first, so both ends are found in one step
+// Inputs:  pointer to the wait list
+//          pointer to a thread that is not in a ready list
+//          SEMA4_FIFO or SEMA4_PRIORITY
+// Outputs: none
+void static WaitInsert(tcbType **waitPt, tcbType *thread, uint32_t order){
+  tcbType *pt = *waitPt;
+  if(pt == 0){                   // only blocked thread
+    thread->BlockNext = thread;
+    *waitPt = thread;
+    return;
+  }
+  if((order == SEMA4_PRIORITY) && (pt->Priority > thread->Priority)){
+    while(pt->BlockNext->Priority <= thread->Priority){
+      pt = pt->BlockNext;        // after threads of higher or equal priority
+    }
+    thread->BlockNext = pt->BlockNext;
+    pt->BlockNext = thread;
+    return;
+  }
+  thread->BlockNext = pt->BlockNext;
+  pt->BlockNext = thread;
+  *waitPt = thread;              // wakes up last
+}
+
+// ******** WaitRemove ************
+// Take a thread out of the middle of a wait list, called with interrupts disabled
+// Inputs:  pointer to the wait list
+//          pointer to a thread in that list
+// Outputs: none
+void static WaitRemove(tcbType **waitPt, tcbType *thread){
+  tcbType *pt = thread;
+  while(pt->BlockNext != thread){
+    pt = pt->BlockNext;
+  }
+  if(pt == thread){
+    *waitPt = 0;                 // it was the only one
+    return;
+  }
+  pt->BlockNext = thread->BlockNext;
+  if(*waitPt == thread){
+    *waitPt = pt;
+  }
+}
+
+// ******** SemaBlock ************
+// Block the running thread on a semaphore, called with interrupts disabled
+// PendSV is triggered here and switches threads as soon as interrupts are
+// enabled, so no other interrupt can run between blocking and the switch
+// Inputs:  pointer to the semaphore count
+//          pointer to the wait list of that semaphore
+//          SEMA4_FIFO or SEMA4_PRIORITY
+// Outputs: none
+void static SemaBlock(int32_t *semaPt, tcbType **waitPt, uint32_t order){
+  ReadyRemove(RunPt);
+  RunPt->BlockPt = semaPt;
+  WaitInsert(waitPt, RunPt, order);
+  TraceRecord(TRACE_BLOCK, (uintptr_t)semaPt);
+  ContextSwitch();
+}
+
+// ******** Preempt ************
+// Switch threads as soon as interrupts are enabled if a thread just made
+// ready has higher priority than the one running, or is an EDF thread
+// due before it, called with interrupts disabled
+// Threads of equal priority wait for the end of the time slice
+// Inputs:  pointer to a thread just made ready
+// Outputs: none
+void static Preempt(tcbType *thread){
+  if((thread->Priority < RunPt->Priority) ||
+     ((thread->Priority == EDFPRIORITY) && (RunPt->Priority == EDFPRIORITY) &&
+      (ReadyPt[EDFPRIORITY]->next == thread))){
+    ContextSwitch();     // PendSV runs next
+  }
+}
+
+// ******** SemaWake ************
+// Wake the first thread blocked on a semaphore, called with interrupts disabled
+// Inputs:  pointer to the wait list of that semaphore
+// Outputs: none
+void static SemaWake(tcbType **waitPt){
+  tcbType *pt = (*waitPt)->BlockNext;
+  if(pt == *waitPt){
+    *waitPt = 0;                 // no more blocked threads
+  } else{
+    (*waitPt)->BlockNext = pt->BlockNext;
+  }
+  pt->BlockPt = 0;
+  if(pt->TimeoutPt){
+    SleepRemove(pt);             // woken before its time ran out
+    pt->TimeoutPt = 0;
+  }
+  ReadyInsert(pt);
+  Preempt(pt);
+}
+
+// int32_t semaphores from OS_InitSemaphore have their wait list in a
+// table, found by hashing the address of the semaphore.  A semaphore
+// has an entry only while threads are blocked on it, so at most half
+// of the entries are in use however many semaphores there are, and a
+// search stops at the first free entry after a step or two
+struct legacysema{
+  int32_t *SemaPt;   // 0 means entry is free
+  tcbType *WaitPt;   // last blocked thread, never 0 while in use
+};
+struct legacysema LegacySema[NUMSEMAPHORES];
+#define LegacyHash(semaPt) (((uintptr_t)(semaPt)>>2)%NUMSEMAPHORES)
+
+// ******** LegacyFind ************
+// Find the entry of an int32_t semaphore, called with interrupts disabled
+// Inputs:  pointer to a counting semaphore
+//          nonzero to give it the free entry that ends the search if it has none
+// Outputs: pointer to its entry, 0 if it has none and none was given
+struct legacysema static *LegacyFind(int32_t *semaPt, uint32_t add){
+  uint32_t i = LegacyHash(semaPt);
+  while(LegacySema[i].SemaPt != semaPt){
+    if(LegacySema[i].SemaPt == 0){
+      if(add == 0){
+        return 0;
+      }
+      LegacySema[i].SemaPt = semaPt; // there is always one, see NUMSEMAPHORES
+      LegacySema[i].WaitPt = 0;
+      break;
+    }
+    i = (i+1)%NUMSEMAPHORES;
+  }
+  return &LegacySema[i];
+}
+
+// ******** LegacyFree ************
+// Free the entry of a semaphore no thread is blocked on any more,
+// called with interrupts disabled.  Entries after it that were put
+// further on because it was in use move back, so every search still
+// stops at the first free entry; no pointer to an entry is kept
+// once interrupts are enabled, so moving them is safe
+// Inputs:  pointer to an entry from LegacyFind
+// Outputs: none
+void static LegacyFree(struct legacysema *pt){
+  uint32_t i = pt-LegacySema;     // free entry
+  uint32_t j = i;                 // entry that might move back to it
+  uint32_t home;
+  for(;;){
+    LegacySema[i].SemaPt = 0;
+    do{
+      j = (j+1)%NUMSEMAPHORES;
+      if(LegacySema[j].SemaPt == 0){
+        return;
+      }
+      home = LegacyHash(LegacySema[j].SemaPt);
+    } while(((j+NUMSEMAPHORES-home)%NUMSEMAPHORES) < ((j+NUMSEMAPHORES-i)%NUMSEMAPHORES));
+    LegacySema[i] = LegacySema[j]; // its search passes i before j
+    i = j;
+  }
+}
+
+// ******** StackAlloc ************
+// Take a stack from the pool, first fit, called with interrupts disabled
+// Inputs:  pointer to the number of bytes needed, a multiple of 8;
+//          set to the bytes given, which may be a few more
+// Outputs: lowest address of the stack, 0 if no free block is big enough
+int32_t static *StackAlloc(uint32_t *size){
+  struct freeblock **pt = &FreePt;
+  struct freeblock *block;
+  while(*pt){
+    block = *pt;
+    if(block->Size >= *size){
+      if((block->Size-*size) < sizeof(struct freeblock)){
+        *pt = block->Next;       // use all of it, too little left over
+        *size = block->Size;
+        return (int32_t *)block;
+      }
+      block->Size -= *size;      // use the top, the rest stays free
+      return (int32_t *)((uint8_t *)block + block->Size);
+    }
+    pt = &block->Next;
+  }
+  return 0;
+}
+
+// ******** StackFree ************
+// Return a stack to the pool, called with interrupts disabled
+// It is joined with the free blocks on either side, so the
+// pool does not break up into pieces too small to use
+// Inputs:  lowest address of the stack
+//          bytes in the stack
+// Outputs: none
+void static StackFree(int32_t *stack, uint32_t size){
+  struct freeblock *block = (struct freeblock *)stack;
+  struct freeblock *before = 0;
+  struct freeblock *after = FreePt;
+  while(after && (after < block)){
+    before = after;
+    after = after->Next;
+  }
+  block->Size = size;
+  block->Next = after;
+  if(after && (((uint8_t *)block + size) == (uint8_t *)after)){
+    block->Size += after->Size;  // join with the block after it
+    block->Next = after->Next;
+  }
+  if(before == 0){
+    FreePt = block;
+  } else if(((uint8_t *)before + before->Size) == (uint8_t *)block){
+    before->Size += block->Size; // join with the block before it
+    before->Next = block->Next;
+  } else{
+    before->Next = block;
+  }
+}
+
+// ******** SetPriority ************
+// Change the priority a thread runs at, called with interrupts disabled
+// A ready thread moves to the ready list of its new priority, and a thread
+// blocked on a mutex moves to its new place in the wait list
+// Inputs:  pointer to a thread
+//          new priority
+// Outputs: none
+void static SetPriority(tcbType *thread, uint32_t priority){
+  if(thread->Priority == priority){
+    return;
+  }
+  if(thread->next){              // ready
+    ReadyRemove(thread);
+    thread->Priority = priority;
+    ReadyInsert(thread);
+  } else if(thread->MutexPt){
+    WaitRemove(&thread->MutexPt->WaitPt, thread);
+    thread->Priority = priority;
+    WaitInsert(&thread->MutexPt->WaitPt, thread, SEMA4_PRIORITY);
+  } else{
+    thread->Priority = priority; // sleeping or blocked on a semaphore
+  }
+}
+
+// ******** MutexInherit ************
+// Priority inheritance, called with interrupts disabled before the
+// running thread blocks on a mutex.  The owner runs at the priority of
+// the running thread until it unlocks, so threads of priority in between
+// can not keep it from finishing.  If the owner is itself blocked on a
+// mutex, the owner of that one is raised too.
+// Inputs:  pointer to a mutex owned by another thread
+// Outputs: none
+void static MutexInherit(MutexType *mutexPt){
+  tcbType *owner = mutexPt->Owner;
+  while(owner->Priority > RunPt->Priority){
+    SetPriority(owner, RunPt->Priority);
+    if(owner->MutexPt == 0){
+      return;
+    }
+    owner = owner->MutexPt->Owner;
+  }
+}
+
+// ******** MutexPriority ************
+// Priority a thread should run at, called with interrupts disabled
+// Inputs:  pointer to a thread
+// Outputs: its own priority, or that of the highest thread blocked on
+//          a mutex it still owns, whichever is higher
+uint32_t static MutexPriority(tcbType *thread){
+  uint32_t priority = thread->BasePriority;
+  MutexType *pt;
+  for(pt=thread->HeldPt; pt; pt=pt->NextHeld){
+    if(pt->WaitPt && (pt->WaitPt->BlockNext->Priority < priority)){
+      priority = pt->WaitPt->BlockNext->Priority; // first waiter is the highest
+    }
+  }
+  return priority;
+}
+
+// ******** MutexRelease ************
+// Give a mutex owned by the running thread to the highest priority
+// thread blocked on it, or free it, called with interrupts disabled
+// Inputs:  pointer to a mutex owned by the running thread
+// Outputs: none
+void static MutexRelease(MutexType *mutexPt){
+  MutexType **heldPt = &RunPt->HeldPt;
+  tcbType *pt;
+  while(*heldPt != mutexPt){     // usually the first, locks are nested
+    heldPt = &(*heldPt)->NextHeld;
+  }
+  *heldPt = mutexPt->NextHeld;
+  if(mutexPt->WaitPt == 0){
+    mutexPt->Owner = 0;          // free
+    mutexPt->Count = 0;
+    return;
+  }
+  pt = mutexPt->WaitPt->BlockNext;
+  if(pt == mutexPt->WaitPt){
+    mutexPt->WaitPt = 0;         // no more blocked threads
+  } else{
+    mutexPt->WaitPt->BlockNext = pt->BlockNext;
+  }
+  pt->MutexPt = 0;
+  mutexPt->Owner = pt;           // locked once by the thread that waited
+  mutexPt->Count = 1;
+  mutexPt->NextHeld = pt->HeldPt;
+  pt->HeldPt = mutexPt;
+  ReadyInsert(pt);
+}
+
+// periodic triggers signaled by RealTimeEvents, each keeps the time of
+// its next release, and they are in a list in release order, so each
+// tick compares only the first one
+struct trigger{
+  int32_t *SemaPt;       // semaphore to signal
+  uint32_t Period;       // msec between signals
+  uint32_t Release;      // RealTime of the next signal
+  struct trigger *Next;  // trigger released after this one, 0 if last
+};
+struct trigger Triggers[NUMTRIGGERS];
+uint32_t NumTriggers;    // entries of Triggers in use
+struct trigger *TriggerPt; // next trigger to release, 0 if none
+uint32_t static RealTimeOn; // nonzero once RealTimeEvents is started
+void RealTimeEvents(void);
+
+// started OS_Timers are in a list in order of expiry, RealTimeEvents
+// compares the first one and signals the timer thread, which runs the
+// callbacks
+TimerType *TimerPt;      // timer that expires first, 0 if none
+int32_t TimerSema;       // signaled when TimerPt is due
+uint32_t TimerDue;       // nonzero from then until the timer thread runs
+uint32_t TimerId;        // Id of the timer thread, 0 until the first OS_Timer_Create
+
+// pins that signal a semaphore or set event flags on an edge, see OS_EdgeSema_Init
+struct edge{
+  uint32_t Port;         // 0 to 5 for GPIO port A to F
+  uint32_t Bit;          // the pin in the port registers, 1 to 0x80
+  uint32_t Edges;        // EDGE_FALLING, EDGE_RISING or EDGE_BOTH
+  uint32_t Debounce;     // msec it is disarmed after an edge, 0 for never
+  uint32_t Count;        // msec until RealTimeEvents arms it again, 0 if armed
+  uint32_t Level;        // debounced, Bit if the pin is high, 0 if low
+  int32_t *SemaPt;       // semaphore to signal, 0 if none
+  EventGroupType *EventPt; // event group to set Flags in, 0 if none
+  uint32_t Flags;
+};
+struct edge Edges[NUMEDGES];
+uint32_t NumEdges;       // entries of Edges in use
+uint32_t Debouncing;     // edges disarmed, RealTimeEvents counts them down
+uint32_t EdgeSignalTime; // DWT_CYCCNT when an edge was last reported, 0 without SIGNALTIMES
+void static EdgeArm(struct edge *pt);
 
 // ******** OS_Init ************
 // Initialize operating system, disable interrupts
@@ -40,14 +718,62 @@ uint32_t static ThreadId=0;   // thread Ids are sequential from 1
 // Initialize OS global variables
 // Inputs:  none
 // Outputs: none
-void OS_Init(void){
-  DisableInterrupts();
+void OS_Init(void){ int i;
+  DisableInterrupts();    // all of them, StartOS enables them
   BSP_Clock_InitFastest();// set processor clock to fastest speed
   NumThread=0;  // number of threads
   ThreadId=0;   // thread Ids are sequential from 1
+  FreeTcbPt = 0;
+  DeadPt = 0;
+  for(i=NUMTHREADS-1; i>=0; i--){
+    tcbs[i].Id = 0;       // all TCBs free, tcbs[0] used first
+    tcbs[i].next = FreeTcbPt;
+    FreeTcbPt = &tcbs[i];
+  }
+  for(i=0; i<NUMPRIORITIES; i++){
+    ReadyPt[i] = 0;       // no ready threads
+  }
+  ReadyBits = 0;
+  CyclesPerMs = BSP_Clock_GetFreq()/1000;
+  DEMCR |= 0x01000000;    // enable trace, so DWT_CYCCNT counts for EDF threads
+  DWT_CTRL |= 0x00000001;
+  FreePt = (struct freeblock *)StackPool; // all of the pool is one free block
+  FreePt->Size = sizeof(StackPool);
+  FreePt->Next = 0;
+  for(i=0; i<NUMSEMAPHORES; i++){
+    LegacySema[i].SemaPt = 0;
+  }
+  NumTriggers = 0;        // RealTimeEvents starts with the first trigger
+  TriggerPt = 0;
+  RealTimeOn = 0;
+  TimerPt = 0;
+  TimerDue = 0;
+  TimerId = 0;
+  NumEdges = 0;
+  Debouncing = 0;
+#if TRACE
+  TraceCount = 0;         // recording starts empty
+  TraceOn = 1;
+#endif
 // perform any initializations needed, 
 // set up periodic timer to run runperiodicevents to implement sleeping
-  BSP_PeriodicTask_InitB(&runperiodicevents, 1000, 0);
+  SleepPt = 0;
+#if TICKLESS
+  SleepArmed = 0;
+  SYSCTL_RCGCTIMER_R |= 0x10;      // 0) activate clock for Timer4
+  while((SYSCTL_PRTIMER_R&0x10) == 0){};// allow time for clock to stabilize
+  TIMER4_CTL_R &= ~TIMER_CTL_TAEN; // 1) disable Timer4A during setup
+  TIMER4_CFG_R = TIMER_CFG_32_BIT_TIMER; // 2) 32-bit timer mode
+  TIMER4_TAMR_R = TIMER_TAMR_TAMR_1_SHOT;// 3) one-shot, down-count
+  TIMER4_TAPR_R = 0;               // 4) bus clock resolution
+  TIMER4_ICR_R = TIMER_ICR_TATOCINT;// 5) clear TIMER4A timeout flag
+  TIMER4_IMR_R |= TIMER_IMR_TATOIM;// 6) arm timeout interrupt
+  NVIC_PRI17_R = (NVIC_PRI17_R&0xFF00FFFF)|(KERNELPRI<<21); // 7) priority KERNELPRI
+// vector number 86, interrupt number 70
+  NVIC_EN2_R = 1<<6;               // 8) enable IRQ 70 in NVIC, started by SleepInsert
+#else
+  BSP_PeriodicTask_InitB(&runperiodicevents, 1000, KERNELPRI);
+#endif
 }
 
 
@@ -58,38 +784,66 @@ void OS_Init(void){
 //         priority (0 is highest)
 // Outputs: Thread ID if successful, 0 if this thread can not be added
 // stack size must be divisable by 8 (aligned to double word boundary)
-int OS_AddThread(void(*task)(void), uint32_t priority){ int status;
-  int n;         // index to new thread TCB 
+int OS_AddThread(void(*task)(void), uint32_t priority){
+  return OS_AddThreadEx(task, priority, STACKSIZE*4);
+}
+
+//******** OS_AddThreadEx *************** 
+// add a foregound thread to the scheduler, with its stack from the pool
+// Inputs: pointer to a void/void foreground function
+//         priority (0 is highest)
+//         number of bytes in its stack, rounded up to a multiple of 8
+// Outputs: Thread ID if successful, 0 if this thread can not be added
+// OS_Kill returns the stack to the pool
+int OS_AddThreadEx(void(*task)(void), uint32_t priority, uint32_t stackBytes){ int status;
   tcbType *NewPt;  // Pointer to nex thread TCB
-  tcbType *LastPt; // Pointer to last thread TCB
   int32_t *sp;      // stack pointer
-  status = StartCritical();
-//  NewPt = malloc(stackSize+10);    // 9 extra bytes needed
-  for(n=0; n< NUMTHREADS; n++){
-    if(tcbs[n].Id == 0) break; // found it 
-    if(n == NUMTHREADS-1){  
-      EndCritical(status);
-      return 0;          // heap is full
-    }
+  int32_t *stack;   // lowest address of its stack
+  uint32_t i;
+  if(stackBytes < STACKMIN){
+    stackBytes = STACKMIN;
   }
-  NewPt = &tcbs[n]; 
-  if(NumThread==0){
-    RunPt = NewPt;  // points to first thread created
-  } else{
-    LastPt = RunPt;
-    while(LastPt->next != RunPt){
-      LastPt = LastPt->next;
-    }
-    LastPt->next = NewPt; // Pointer to Next  
+  stackBytes = (stackBytes+7)&~7; // double word boundary
+  status = StartMask();
+  if(FreeTcbPt == 0){
+    EndMask(status);
+    return 0;            // heap is full
+  }
+  stack = StackAlloc(&stackBytes);
+  if(stack == 0){
+    EndMask(status);
+    return 0;            // stack pool is full
+  }
+  NewPt = FreeTcbPt;     // top of the free TCB stack
+  FreeTcbPt = NewPt->next;
+  NewPt->StackPt = stack;
+  NewPt->StackSize = stackBytes;
+  for(i=0; i<stackBytes/4; i++){
+    stack[i] = STACKPAINT;  // for OS_StackUsed, stack[0] is the guard word
+  }
+  if((priority >= IDLEPRIORITY) && (task != &IdleThread)){
+    priority = IDLEPRIORITY-1;   // lowest priority, just above the idle thread
   }
   NewPt->Priority =  priority;
+  NewPt->BasePriority = priority;
+  NewPt->MutexPt = 0;     // not blocked on a mutex, and holds none
+  NewPt->HeldPt = 0;
+  NewPt->TimeoutPt = 0;
+  NewPt->Period = 0;      // fixed priority, OS_AddEdfThread makes it EDF
+  NewPt->Misses = 0;
+  NewPt->Task = task;
+  NewPt->Cycles = 0;
+  NewPt->Switches = 0;
+  NewPt->MaxBurst = 0;
   NumThread++;
   ThreadId++;
   NewPt->Id = ThreadId;
   NewPt->BlockPt =  0;    // not blocked
+  NewPt->BlockNext = 0;
   NewPt->Sleep =  0;      // not sleeping
+  NewPt->SleepNext = 0;
 
-  sp = &Stacks[n][STACKSIZE-1];      // last entry of stack
+  sp = &stack[stackBytes/4-1];       // last entry of stack
 
 
 // derived from uCOS-II
@@ -104,6 +858,8 @@ int OS_AddThread(void(*task)(void), uint32_t priority){ int status;
   *(--sp)  = (long)0x000000000;             /* R0                                                 */
 
                                             /* Remaining registers saved on process stack         */
+  *(--sp)  = (long)0xFFFFFFF9L;             /* EXC_RETURN, thread mode on MSP without FPU state   */
+  *(--sp)  = (long)0x12121212L;             /* R12, pad so the stack stays 8-byte aligned         */
   *(--sp)  = (long)0x11111111L;             /* R11                                                */
   *(--sp)  = (long)0x10101010L;             /* R10                                                */
   *(--sp)  = (long)0x09090909L;             /* R9                                                 */
@@ -113,10 +869,308 @@ int OS_AddThread(void(*task)(void), uint32_t priority){ int status;
   *(--sp)  = (long)0x05050505L;             /* R5                                                 */
   *(--sp)  = (long)0x04040404L;             /* R4                                                 */
   NewPt->sp = sp;        // make stack "look like it was previously suspended"
-  NewPt->next = RunPt;   // Pointer to first, circular linked list 
-  EndCritical(status);
-  return 1;
+  ReadyInsert(NewPt);    // runs next among threads of its priority
+  EndMask(status);
+  return ThreadId;
+}
+//******** OS_AddEdfThread *************** 
+// add a foregound thread scheduled earliest deadline first, with its
+// stack from the pool
+// It runs at priority EDFPRIORITY, ahead of the other EDF threads whose
+// jobs are due later; its first job is released now, or at OS_Launch
+// Inputs: pointer to a void/void foreground function, that calls
+//         OS_EdfWait at the end of each job
+//         period in msec, 1 to EDFMAX
+//         relative deadline in msec, 1 to EDFMAX
+//         number of bytes in its stack, rounded up to a multiple of 8
+// Outputs: Thread ID if successful, 0 if this thread can not be added
+int OS_AddEdfThread(void(*task)(void), uint32_t period, uint32_t deadline, uint32_t stackBytes){
+  tcbType *pt;
+  int id;
+  int status;
+  if((period == 0) || (period > EDFMAX) || (deadline == 0) || (deadline > EDFMAX)){
+    return 0;
+  }
+  status = StartMask();
+  pt = FreeTcbPt;        // the TCB OS_AddThreadEx takes
+  id = OS_AddThreadEx(task, EDFPRIORITY, stackBytes);
+  if(id){
+    ReadyRemove(pt);     // added round robin, move it to its deadline
+    pt->Period = period*CyclesPerMs;
+    pt->Deadline = deadline*CyclesPerMs;
+    pt->Release = DWT_CYCCNT;
+    ReadyInsert(pt);
+  }
+  EndMask(status);
+  return id;
 }
+
+// ******** OS_EdfWait ************
+// End the current job of the running EDF thread and wait for the next
+// release, one period after this one; a job that ends after its deadline
+// is counted as a miss, and if the next job is already late it is
+// released right away
+// A thread from OS_AddThread just gives up the rest of its time slice
+// Inputs:  none
+// Outputs: none
+void OS_EdfWait(void){ uint32_t now;
+  int32_t wait;
+  MaskInterrupts();
+  if(RunPt->Period){
+    now = DWT_CYCCNT;
+    if((int32_t)(now-(RunPt->Release+RunPt->Deadline)) > 0){
+      RunPt->Misses++;
+    }
+    RunPt->Release += RunPt->Period; // no drift, releases stay one period apart
+    wait = (int32_t)(RunPt->Release-now);
+    ReadyRemove(RunPt);
+    if(wait > 0){        // wakes on the sleep tick within 1 msec of the release
+      SleepInsert(RunPt, ((uint32_t)wait+CyclesPerMs-1)/CyclesPerMs);
+    } else{
+      ReadyInsert(RunPt);// late, in the list again by its new deadline
+    }
+  }
+  ContextSwitch();       // PendSV runs as soon as interrupts are enabled
+  UnmaskInterrupts();
+}
+
+// ******** OS_DeadlineMisses ************
+// Number of jobs of an EDF thread that finished after their deadline
+// Inputs:  Thread Id, from OS_AddEdfThread or OS_Id
+// Outputs: misses since it was added, -1 if there is no thread with that Id
+int32_t OS_DeadlineMisses(uint32_t id){ int i;
+  for(i=0; i<NUMTHREADS; i++){
+    if(id && (tcbs[i].Id == id)){
+      return tcbs[i].Misses;
+    }
+  }
+  return -1;
+}
+
+// ******** OS_IsrEnter ************
+// Start counting time in an interrupt, so OS_GetStats does not charge
+// it to the thread it interrupted; call first thing in the handler
+// Inputs:  none
+// Outputs: none
+void OS_IsrEnter(void){
+#if CPUSTATS || TRACE
+  long sr = StartMask();
+#if CPUSTATS
+  if(IsrDepth == 0){
+    IsrStart = DWT_CYCCNT; // nested ones are already counted
+  }
+  IsrDepth++;
+#endif
+  TraceRecord(TRACE_ISRENTER, 0);
+  EndMask(sr);
+#endif
+}
+
+// ******** OS_IsrExit ************
+// Stop counting time in an interrupt, call last thing in the handler
+// Inputs:  none
+// Outputs: none
+void OS_IsrExit(void){
+#if CPUSTATS || TRACE
+  long sr = StartMask();
+#if CPUSTATS
+  uint32_t run;
+  IsrDepth--;
+  if(IsrDepth == 0){
+    run = DWT_CYCCNT-IsrStart;
+    IsrRun += run;
+    IsrCycles += run;
+  }
+#endif
+  TraceRecord(TRACE_ISREXIT, 0);
+  EndMask(sr);
+#endif
+}
+
+#if MASKSTATS
+uint32_t static MaskTime;     // DWT_CYCCNT when the kernel masked interrupts
+uint32_t static MaskLine;     // line of os.c that masked them
+uint32_t static MaskMax;      // longest masked time since the last OS_MaskStats, bus cycles
+uint32_t static MaskMaxStart; // lines of os.c that masked and unmasked for MaskMax
+uint32_t static MaskMaxEnd;
+
+// ******** MaskEnter ************
+// Mask the interrupts that may call the OS, and if they were not
+// already masked, note the time and where
+// Inputs:  line of os.c
+// Outputs: BASEPRI before, for MaskLeave
+uint32_t static MaskEnter(uint32_t line){
+  uint32_t sr = SetBasePri(KERNELMASK);
+  if(sr == 0){             // nested ones are part of the outer one
+    MaskTime = DWT_CYCCNT;
+    MaskLine = line;
+  }
+  return sr;
+}
+
+// ******** MaskLeave ************
+// Set BASEPRI back, and if that unmasks interrupts, keep the
+// time they were masked if it is the longest so far
+// Inputs:  BASEPRI from MaskEnter, 0 to unmask
+//          line of os.c
+// Outputs: none
+void static MaskLeave(uint32_t basepri, uint32_t line){
+  uint32_t time;
+  if((SetBasePri(KERNELMASK) != 0) && (basepri == 0)){
+    time = DWT_CYCCNT-MaskTime;
+    if(time > MaskMax){
+      MaskMax = time;
+      MaskMaxStart = MaskLine;
+      MaskMaxEnd = line;
+    }
+  }
+  SetBasePri(basepri);
+}
+#endif
+
+// ******** OS_MaskStats ************
+// Longest time the kernel held the interrupts of priority KERNELPRI
+// to 7 pending since the last call, or since the start, then start
+// again; the switch in PendSV_Handler and the I bit in OS_Init and
+// the idle thread are not counted.  Needs MASKSTATS 1 in os.c
+// Inputs:  where to put the lines of os.c that masked and unmasked
+// Outputs: bus cycles, 0 without MASKSTATS
+uint32_t OS_MaskStats(uint32_t *startLine, uint32_t *endLine){
+  uint32_t max = 0;
+#if MASKSTATS
+  uint32_t sr = StartMask();
+  max = MaskMax;
+  *startLine = MaskMaxStart;
+  *endLine = MaskMaxEnd;
+  MaskMax = 0;
+  EndMask(sr);
+#else
+  *startLine = 0;
+  *endLine = 0;
+#endif
+  return max;
+}
+
+// ******** OS_GetStats ************
+// CPU use of each thread since the last call, or since OS_Launch,
+// then start counting again; calls must be less than 53 s apart at 80 MHz
+// Inputs:  array to fill, one entry per thread
+//          number of entries in the array
+//          where to put the time in interrupts, in 0.01%, counting the
+//          kernel interrupts and those that call OS_IsrEnter and OS_IsrExit
+// Outputs: number of entries filled, 0 without CPUSTATS
+int OS_GetStats(ThreadStatsType *stats, int max, uint32_t *isrPercent){
+  int i,n = 0;
+#if CPUSTATS
+  uint32_t now,window;
+  long sr = StartMask();
+  StatsCharge();         // the running thread, up to now
+  now = SwitchTime;
+  window = now-StatsTime;
+  if(window == 0){
+    window = 1;
+  }
+  for(i=0; (i<NUMTHREADS) && (n<max); i++){
+    if(tcbs[i].Id){
+      stats[n].Id = tcbs[i].Id;
+      stats[n].Task = tcbs[i].Task;
+      stats[n].Priority = tcbs[i].Priority;
+      stats[n].Percent = ((uint64_t)tcbs[i].Cycles*10000)/window;
+      stats[n].Switches = tcbs[i].Switches;
+      stats[n].MaxBurst = tcbs[i].MaxBurst;
+      n++;
+    }
+    tcbs[i].Cycles = 0;
+    tcbs[i].Switches = 0;
+    tcbs[i].MaxBurst = 0;
+  }
+  *isrPercent = ((uint64_t)IsrCycles*10000)/window;
+  IsrCycles = 0;
+  StatsTime = now;
+  Burst = 0;             // its longest burst starts again too
+  EndMask(sr);
+#endif
+  return n;
+}
+
+#if TRACE
+// ******** TraceHex ************
+// Send a number in hex, most significant digit first
+// Inputs:  function that sends one character
+//          number, digits to send
+//          character sent after it
+// Outputs: none
+void static TraceHex(void(*outChar)(char), uint32_t n, uint32_t digits, char end){
+  while(digits){
+    digits--;
+    outChar("0123456789ABCDEF"[(n>>(4*digits))&0x0F]);
+  }
+  outChar(end);
+}
+
+// ******** TraceString ************
+// Send a string, without its null
+// Inputs:  function that sends one character
+//          string to send
+// Outputs: none
+void static TraceString(void(*outChar)(char), const char *pt){
+  while(*pt){
+    outChar(*pt);
+    pt++;
+  }
+}
+#endif
+
+// ******** OS_TraceDump ************
+// Send the kernel events recorded since the last call, or since OS_Init,
+// oldest first, one line each, with the threads alive; recording stops
+// while they are sent and starts again empty
+// Inputs:  function that sends one character, like UART0_OutChar
+// Outputs: number of events sent, 0 without TRACE
+uint32_t OS_TraceDump(void(*outChar)(char)){
+  uint32_t n = 0;
+#if TRACE
+  uint32_t i,count,first;
+  struct traceevent *pt;
+  long sr = StartMask();
+  TraceOn = 0;           // TraceBuf stays as it is while it is sent
+  count = TraceCount;
+  EndMask(sr);
+  first = 0;
+  if(count > TRACESIZE){
+    first = count-TRACESIZE; // the older ones were written over
+  }
+  TraceString(outChar, "trace,");
+  TraceHex(outChar, BSP_Clock_GetFreq(), 8, ',');
+  TraceHex(outChar, first, 8, '\n');
+  outChar('\r');
+  for(i=first; i<count; i++){
+    pt = &TraceBuf[i&(TRACESIZE-1)];
+    TraceHex(outChar, pt->Time, 8, ',');
+    TraceHex(outChar, pt->Event, 2, ',');
+    TraceHex(outChar, pt->Id, 2, ',');
+    TraceHex(outChar, pt->Arg, 4, '\n');
+    outChar('\r');
+  }
+  for(i=0; i<NUMTHREADS; i++){
+    if(tcbs[i].Id){
+      TraceString(outChar, "thread,");
+      TraceHex(outChar, tcbs[i].Id, 8, ',');
+      TraceHex(outChar, (uintptr_t)tcbs[i].Task, 8, ',');
+      TraceHex(outChar, tcbs[i].Priority, 2, '\n');
+      outChar('\r');
+    }
+  }
+  TraceString(outChar, "end\n\r");
+  n = count-first;
+  sr = StartMask();
+  TraceCount = 0;
+  TraceOn = 1;
+  EndMask(sr);
+#endif
+  return n;
+}
+
 // ****OS_Id**********
 // returns the Id for the currently running thread
 // Input:  none
@@ -125,50 +1179,176 @@ uint32_t OS_Id(void){
   return RunPt->Id;
 }
 
-void static runperiodicevents(void){
-// ****IMPLEMENT THIS****
-// **DECREMENT SLEEP COUNTERS
+// ******** OS_StackUsed ************
+// Most stack a thread has used since it was added, found by
+// looking for the lowest word that no longer holds STACKPAINT
+// Inputs:  Thread Id, from OS_AddThread or OS_Id
+// Outputs: peak bytes used, including the frame saved when it is
+//          switched out, -1 if there is no thread with that Id
+int32_t OS_StackUsed(uint32_t id){ int i;
+  uint32_t n;
+  for(i=0; i<NUMTHREADS; i++){
+    if(id && (tcbs[i].Id == id)){
+      n = 0;
+      while((n < tcbs[i].StackSize/4) && (tcbs[i].StackPt[n] == STACKPAINT)){
+        n++;
+      }
+      return tcbs[i].StackSize-4*n;
+    }
+  }
+  return -1;
+}
+
+// runs every ms, or in TICKLESS mode when the first sleeping thread is due
+// only the first sleeping thread is counted down, threads after
+// it with a zero Sleep field wake up at the same time
 // In Lab 4, handle periodic events in RealTimeEvents
-  	int32_t i;
-	for(i=0; i<NUMTHREADS; i++){
-		if((tcbs[i].Sleep) > 0){
-			tcbs[i].Sleep--;
-		}
-	}
+void static runperiodicevents(void){
+  tcbType *pt;
+  OS_IsrEnter();
+  if(SleepPt == 0){
+#if TICKLESS
+    SleepArmed = 0;              // SleepRemove took the thread it was started for
+#endif
+    OS_IsrExit();
+    return;
+  }
+#if TICKLESS
+  SleepPt->Sleep -= SleepArmed;  // Timer4A counted this many msec
+  SleepArmed = 0;
+#else
+  SleepPt->Sleep--;
+#endif
+  while(SleepPt && (SleepPt->Sleep == 0)){
+    pt = SleepPt;
+    SleepPt = pt->SleepNext;
+    if(pt->TimeoutPt){           // gives up waiting on a semaphore
+      WaitRemove(&pt->TimeoutPt->WaitPt, pt);
+      pt->TimeoutPt->Value++;
+      pt->BlockPt = 0;
+    }
+    ReadyInsert(pt);             // done sleeping
+    Preempt(pt);
+  }
+#if TICKLESS
+  if(SleepPt){
+    SleepTimer_Start(SleepPt->Sleep); // otherwise no interrupts until the next OS_Sleep
+  }
+#endif
+  OS_IsrExit();
+}
+#if TICKLESS
+void TIMER4A_Handler(void){
+  TIMER4_ICR_R = TIMER_ICR_TATOCINT;// acknowledge TIMER4A timeout
+  runperiodicevents();
+}
+#endif
+
+// ******** IdleThread ************
+// Kernel idle thread, the only one at IDLEPRIORITY, so it runs only when
+// every other thread is sleeping or blocked.  Nothing needs a time slice
+// then, so SysTick is stopped and the processor sleeps until the next
+// interrupt (sleep timer, periodic trigger, edge).  If that interrupt
+// makes a thread ready, it starts with a whole time slice.
+// It uses the I bit, not BASEPRI, as WFI does not wake up for an
+// interrupt BASEPRI holds pending; those of priority 0 to KERNELPRI-1
+// wait only for the few instructions after the WFI.
+// Inputs:  none
+// Outputs: none
+void static IdleThread(void){
+  for(;;){
+    DisableInterrupts();       // the interrupt that wakes it runs after SysTick is back
+    STCTRL = 0;                // no SysTick interrupts while idle
+    WaitForInterrupt();
+    STCURRENT = 0;             // any write to current clears it
+    STCTRL = 0x00000007;       // enable, core clock and interrupt arm
+    EnableInterrupts();        // the interrupt runs, then PendSV if it readied a thread
+  }
 }
 
 //******** OS_Launch ***************
 // Start the scheduler, enable interrupts
+// Adds the kernel idle thread, which sleeps the processor when no other
+// thread is ready
 // Inputs: number of clock cycles for each time slice
 // Outputs: none (does not return)
 // Errors: theTimeSlice must be less than 16,777,216
-void OS_Launch(uint32_t theTimeSlice){
+void OS_Launch(uint32_t theTimeSlice){ int i;
+  if(OS_AddThreadEx(&IdleThread, IDLEPRIORITY, IDLESTACK) == 0){
+    for(;;){};     // crash, no TCB or stack left for it
+  }
+  for(i=0; i<NUMTHREADS; i++){ // first jobs of the EDF threads are released now
+    if(tcbs[i].Id && tcbs[i].Period){
+      ReadyRemove(&tcbs[i]);
+      tcbs[i].Release = DWT_CYCCNT;
+      ReadyInsert(&tcbs[i]);
+    }
+  }
   STCTRL = 0;                  // disable SysTick during setup
   STCURRENT = 0;               // any write to current clears it
   SYSPRI3 =(SYSPRI3&0x0000FFFF)|0xE0E00000; // priority 7, SysTick and PendSV
   STRELOAD = theTimeSlice - 1; // reload value
+  Scheduler();                 // RunPt points to highest priority thread
+#if CPUSTATS
+  SwitchTime = DWT_CYCCNT;     // RunPt starts its first burst
+  StatsTime = SwitchTime;
+  Burst = 0;
+  IsrRun = 0;
+  IsrCycles = 0;
+#endif
   STCTRL = 0x00000007;         // enable, core clock and interrupt arm
   StartOS();                   // start on the first task
 }
+// runs at the end of each time slice
+// the switch itself is done in PendSV_Handler
+void SysTick_Handler(void){
+  ContextSwitch();
+}
 // runs every ms
-void Scheduler(void){      // every time slice
-// ****IMPLEMENT THIS****
-// look at all threads in TCB list choose
-// highest priority thread not blocked and not sleeping 
+// choose the highest priority thread not blocked and not sleeping
 // If there are multiple highest priority (not blocked, not sleeping) run these round robin
-uint32_t max = 255;
-	tcbType *pt;
-	tcbType *bestPt;
-	pt = RunPt;
-	
-	do{
-		pt = pt->next;
-		if((pt->Priority < max) && ((pt->BlockPt) == 0) && ((pt->Sleep) == 0)){
-		bestPt = pt;
-			max = pt -> Priority;
-		}
-	} while(RunPt != pt);			// look at all the possible threads
-	RunPt = bestPt;
+// Blocked and sleeping threads are not in the ready lists, so the time
+// to choose does not depend on the number of threads
+// The kernel idle thread is always ready, so there is always a thread to run
+// EDF threads are not rotated, the one whose job is due first runs
+// With STACKCHECK, the thread switched out is checked for a stack overflow
+// With CPUSTATS, the thread switched out is charged for the time it ran
+// With TRACE, a switch to another thread is recorded
+// A thread OS_Kill just killed is off its stack now, so its stack and
+// TCB are freed here
+void Scheduler(void){      // every time slice
+  tcbType *pt;
+#if STACKCHECK
+  if(RunPt && RunPt->Id && (RunPt->StackPt[0] != STACKPAINT)){
+    StackOverflowId = RunPt->Id; // it has used all of its stack, and maybe more
+    for(;;){};     // crash
+  }
+#endif
+  pt = ReadyPt[__clz(ReadyBits)]->next; // next ready thread at highest priority
+  if((pt->Priority != EDFPRIORITY) || (pt->Period == 0)){
+    ReadyPt[pt->Priority] = pt;  // round robin
+  }
+#if CPUSTATS
+  if(pt != RunPt){
+    if(RunPt){
+      StatsCharge();
+    }
+    Burst = 0;
+    pt->Switches++;
+  }
+#endif
+#if TRACE
+  if(pt != RunPt){
+    TraceRecord(TRACE_SWITCH, pt->Id); // recorded for the thread switched out
+  }
+#endif
+  RunPt = pt;
+  if(DeadPt){
+    StackFree(DeadPt->StackPt, DeadPt->StackSize);
+    DeadPt->next = FreeTcbPt;
+    FreeTcbPt = DeadPt;
+    DeadPt = 0;
+  }
 }
 
 //******** OS_Suspend ***************
@@ -176,57 +1356,33 @@ uint32_t max = 255;
 // Inputs: none
 // Outputs: none
 // Will be run again depending on sleep/block status
+// SysTick is not touched, so time slices stay on the same period
+// and the next thread runs for the rest of this one
 void OS_Suspend(void){
-  STCURRENT = 0;        // any write to current clears it
-  INTCTRL = 0x04000000; // trigger SysTick
-// next thread gets a full time slice
+  ContextSwitch();      // trigger PendSV
 }
 // ******** OS_Kill ************
 // kill the currently running thread, release its TCB memory
 // input:  none
 // output: none
-tcbType *previousPt;   // Pointer to previous thread in list before current thread
-tcbType *nextPt;       // Pointer to next thread in list after current thread
-tcbType *killPt;       // Pointer to thread being killed
 // RunPt will point to thread will be killed 
 void OS_Kill(void){  // no local variables allowed
-  DisableInterrupts();        // atomic
+  MaskInterrupts();           // atomic
+  TraceRecord(TRACE_KILL, 0);
   NumThread--;
   if(NumThread==0){
     for(;;){};     // crash
   }
-  RunPt->Sleep = 0xFFFFFFFF;  // can't rerun this thread, it will be dead
-  killPt = RunPt;             // kill current thread
-	Scheduler();                // RunPt points to thread to run next
-//********initially RunPt points to thread to kill********
-//               /----\           /----\          /----\
-//               |    |  killPt-> |    |          |    |
-//               |next----------> |next---------> |next--->
-//               |    |           |    |          |    |
-//               \----/           \----/          \----/
-  killPt->Id = 0;         // mark as free
- 
-  previousPt = killPt;    // eventually, it will point to previous thread 
-  nextPt = killPt->next;  // nextPt points to the thread after 
-  while((previousPt->next)!=killPt){
-    previousPt = previousPt->next;  
-  }
-//****previousPt -> one before, RunPt to thread to kill *********
-//               /----\           /----\          /----\
-// previousPt -> |    |  killPt-> |    | nextPt-> |    |
-//               |next----------> |next---------> |next--->
-//               |    |           |    |          |    |
-//               \----/           \----/          \----/
-  previousPt->next = nextPt; // remove from list
-//****remove thread which we are killing *********
-//               /----\                           /----\
-// previousPt -> |    |                  nextPt-> |    |
-//               |next--------------------------> |next--->
-//               |    |                           |    |
-//               \----/                           \----/
-  STCURRENT = 0;        // next thread get full slice
-  EnableInterrupts();
-  INTCTRL = 0x10000000; // trigger pendSV to start next thread
+  while(RunPt->HeldPt){       // a dead thread can not unlock
+    MutexRelease(RunPt->HeldPt);
+  }
+  ReadyRemove(RunPt);         // can't rerun this thread, it will be dead
+  RunPt->Id = 0;              // mark as free
+  DeadPt = RunPt;             // it runs on its stack, and PendSV saves its sp, so
+                              // Scheduler frees them once it has switched away
+  ContextSwitch();      // trigger PendSV to switch to the next thread
+  UnmaskInterrupts();
+  EnableInterrupts();   // the I bit too, if the thread set it
   for(;;){};            // can not return
 }
 // ******** OS_Sleep ************
@@ -239,8 +1395,14 @@ void OS_Sleep(uint32_t sleepTime){
 // set sleep parameter in TCB, same as Lab 3
 // suspend, stops running
 		//---MyCode---
-	RunPt->Sleep = sleepTime;
-	OS_Suspend();
+	MaskInterrupts();
+	TraceRecord(TRACE_SLEEP, sleepTime);
+	if(sleepTime){
+		ReadyRemove(RunPt);
+		SleepInsert(RunPt, sleepTime);	// ready again when it reaches the front and counts down
+	}
+	ContextSwitch();	// PendSV runs as soon as interrupts are enabled, no tick can come first
+	UnmaskInterrupts();
 	//---MyCodeEnd---
 
 }
@@ -254,7 +1416,7 @@ void OS_InitSemaphore(int32_t *semaPt, int32_t value){
 // ****IMPLEMENT THIS****
 // Same as Lab 3
  		//-----My Code-----
-	(*semaPt) = value;
+	(*semaPt) = value;	// threads still blocked on it stay in its wait list
 	//-----My Code End-----
 }
 
@@ -268,14 +1430,13 @@ void OS_Wait(int32_t *semaPt){
 // ****IMPLEMENT THIS****
 // Same as Lab 3
   	//-----My Code-----
-	DisableInterrupts();
+	MaskInterrupts();
+	TraceRecord(TRACE_WAIT, (uintptr_t)semaPt);
 	(*semaPt) = (*semaPt) - 1;
 	if((*semaPt) < 0){
-		RunPt -> BlockPt = semaPt; 
-		EnableInterrupts();
-		OS_Suspend();
+		SemaBlock(semaPt, &LegacyFind(semaPt, 1)->WaitPt, SEMA4_PRIORITY); // switches at UnmaskInterrupts
 	}
-	EnableInterrupts();
+	UnmaskInterrupts();
 //-----My Code End-----
 }
 
@@ -289,26 +1450,479 @@ void OS_Signal(int32_t *semaPt){
 // ****IMPLEMENT THIS****
 // Same as Lab 3
   //-----My Code-----
-	tcbType *pt;
-	DisableInterrupts();
+	struct legacysema *pt;
+	MaskInterrupts();
+	TraceRecord(TRACE_SIGNAL, (uintptr_t)semaPt);
 	(*semaPt) = (*semaPt) + 1;
 	if((*semaPt) <= 0){
-		pt = RunPt->next;				//search for a thread blocked on this semaphore
-		while(pt->BlockPt != semaPt){
-			pt = pt->next;
+		pt = LegacyFind(semaPt, 0);
+		if(pt){				//none if initialized negative
+			SemaWake(&pt->WaitPt);
+			if(pt->WaitPt == 0){
+				LegacyFree(pt);	// entry for another semaphore
+			}
 		}
-		pt->BlockPt = 0;
 	}
-	EnableInterrupts();
+	UnmaskInterrupts();
 //-----My Code End-----
 }
 
-#define FSIZE 10    // can be any size
-uint32_t PutI;      // index of where to put next
-uint32_t GetI;      // index of where to get next
+// ******** OS_InitSema4 ************
+// Initialize a counting semaphore with its own wait list
+// Inputs:  pointer to a semaphore
+//          initial value of semaphore
+//          SEMA4_FIFO wakes threads in the order they blocked
+//          SEMA4_PRIORITY wakes the highest priority thread first
+// Outputs: none
+void OS_InitSema4(Sema4Type *semaPt, int32_t value, uint32_t order){
+  semaPt->Value = value;
+  semaPt->Order = order;
+  semaPt->WaitPt = 0;     // no blocked threads
+}
+
+// ******** OS_WaitSema4 ************
+// Decrement semaphore and block if less than zero
+// Inputs:  pointer to a semaphore
+// Outputs: none
+void OS_WaitSema4(Sema4Type *semaPt){
+  MaskInterrupts();
+  TraceRecord(TRACE_WAIT, (uintptr_t)semaPt);
+  semaPt->Value = semaPt->Value - 1;
+  if(semaPt->Value < 0){
+    SemaBlock(&semaPt->Value, &semaPt->WaitPt, semaPt->Order); // switches at UnmaskInterrupts
+  }
+  UnmaskInterrupts();
+}
+
+// ******** OS_SignalSema4 ************
+// Increment semaphore, wakeup the first blocked thread
+// Inputs:  pointer to a semaphore
+// Outputs: none
+void OS_SignalSema4(Sema4Type *semaPt){
+  MaskInterrupts();
+  TraceRecord(TRACE_SIGNAL, (uintptr_t)semaPt);
+  semaPt->Value = semaPt->Value + 1;
+  if((semaPt->Value <= 0) && semaPt->WaitPt){
+    SemaWake(&semaPt->WaitPt);
+  }
+  UnmaskInterrupts();
+}
+
+// ******** OS_InitMutex ************
+// Initialize a mutex, not locked
+// Inputs:  pointer to a mutex
+// Outputs: none
+void OS_InitMutex(MutexType *mutexPt){
+  mutexPt->Owner = 0;
+  mutexPt->Count = 0;
+  mutexPt->WaitPt = 0;    // no blocked threads
+  mutexPt->NextHeld = 0;
+}
+
+// ******** OS_LockMutex ************
+// Lock a mutex, blocking while another thread owns it
+// The owner inherits the priority of the highest thread blocked, so the
+// time blocked is bounded by the critical sections of lower threads
+// The owner may lock it again, it must unlock as many times
+// Before OS_Launch it does nothing, so main can share code with threads
+// Inputs:  pointer to a mutex
+// Outputs: none
+void OS_LockMutex(MutexType *mutexPt){
+  if(RunPt == 0){
+    return;               // before OS_Launch, main is the only thread
+  }
+  MaskInterrupts();
+  if(mutexPt->Owner == 0){
+    mutexPt->Owner = RunPt;
+    mutexPt->Count = 1;
+    mutexPt->NextHeld = RunPt->HeldPt;
+    RunPt->HeldPt = mutexPt;
+  } else if(mutexPt->Owner == RunPt){
+    mutexPt->Count++;     // recursive lock
+  } else{
+    MutexInherit(mutexPt);
+    ReadyRemove(RunPt);
+    RunPt->MutexPt = mutexPt;
+    WaitInsert(&mutexPt->WaitPt, RunPt, SEMA4_PRIORITY);
+    ContextSwitch();      // runs again as the owner
+  }
+  UnmaskInterrupts();
+}
+
+// ******** OS_UnlockMutex ************
+// Unlock a mutex, the highest priority thread blocked on it becomes
+// the owner, and the running thread drops any priority it inherited
+// Inputs:  pointer to a mutex
+// Outputs: 0 if successful, -1 if the running thread does not own it
+int OS_UnlockMutex(MutexType *mutexPt){
+  if(RunPt == 0){
+    return 0;             // before OS_Launch, OS_LockMutex did nothing
+  }
+  MaskInterrupts();
+  if(mutexPt->Owner != RunPt){
+    UnmaskInterrupts();
+    return -1;            // not locked by this thread
+  }
+  mutexPt->Count--;
+  if(mutexPt->Count == 0){
+    MutexRelease(mutexPt);
+    SetPriority(RunPt, MutexPriority(RunPt));
+    if(__clz(ReadyBits) < RunPt->Priority){
+      ContextSwitch();    // new owner or another thread is higher now
+    }
+  }
+  UnmaskInterrupts();
+  return 0;
+}
+
+// ******** EventsMet ************
+// Check if a wait for event flags is over
+// Inputs:  flags that are set
+//          flags waited for
+//          EVENT_ANY or EVENT_ALL, plus EVENT_CLEAR
+// Outputs: the flags waited for that are set, 0 if the wait is not over
+uint32_t static EventsMet(uint32_t flags, uint32_t mask, uint32_t options){
+  flags &= mask;
+  if((options&EVENT_ALL) && (flags != mask)){
+    return 0;
+  }
+  return flags;
+}
+
+// ******** OS_InitEventGroup ************
+// Initialize a group of 32 event flags
+// Inputs:  pointer to an event group
+//          flags that start out set
+// Outputs: none
+void OS_InitEventGroup(EventGroupType *groupPt, uint32_t flags){
+  groupPt->Flags = flags;
+  groupPt->WaitPt = 0;    // no blocked threads
+}
+
+// ******** OS_SetEvents ************
+// Set event flags, and wake up every thread whose wait is now over,
+// in the order they blocked.  Flags of EVENT_CLEAR waits are cleared
+// after all are woken, so threads waiting on the same flag all see it.
+// Can be called from an interrupt handler
+// Inputs:  pointer to an event group
+//          flags to set
+// Outputs: none
+void OS_SetEvents(EventGroupType *groupPt, uint32_t flags){
+  tcbType *last,*before,*pt;
+  uint32_t clear = 0;
+  MaskInterrupts();
+  groupPt->Flags |= flags;
+  last = groupPt->WaitPt;
+  if(last){
+    before = last;
+    do{
+      pt = before->BlockNext;
+      flags = EventsMet(groupPt->Flags, pt->EventMask, pt->EventOptions);
+      if(flags){
+        if(pt == before){
+          groupPt->WaitPt = 0;   // it was the only one
+        } else{
+          before->BlockNext = pt->BlockNext;
+          if(pt == groupPt->WaitPt){
+            groupPt->WaitPt = before;
+          }
+        }
+        if(pt->EventOptions&EVENT_CLEAR){
+          clear |= pt->EventMask;
+        }
+        pt->EventMask = flags;   // returned by its OS_WaitEvents
+        ReadyInsert(pt);
+        Preempt(pt);
+      } else{
+        before = pt;
+      }
+    } while(pt != last);
+  }
+  groupPt->Flags &= ~clear;
+  UnmaskInterrupts();
+}
+
+// ******** OS_ClearEvents ************
+// Clear event flags
+// Inputs:  pointer to an event group
+//          flags to clear
+// Outputs: none
+void OS_ClearEvents(EventGroupType *groupPt, uint32_t flags){
+  MaskInterrupts();
+  groupPt->Flags &= ~flags;
+  UnmaskInterrupts();
+}
+
+// ******** OS_WaitEvents ************
+// Block until any or all of the flags in a mask are set
+// Inputs:  pointer to an event group
+//          flags to wait for
+//          EVENT_ANY or EVENT_ALL, plus EVENT_CLEAR to clear the
+//          flags in the mask when the wait is over
+// Outputs: the flags in the mask that were set when the wait ended
+uint32_t OS_WaitEvents(EventGroupType *groupPt, uint32_t mask, uint32_t options){
+  uint32_t flags;
+  MaskInterrupts();
+  flags = EventsMet(groupPt->Flags, mask, options);
+  if(flags){
+    if(options&EVENT_CLEAR){
+      groupPt->Flags &= ~mask;
+    }
+    UnmaskInterrupts();
+    return flags;
+  }
+  RunPt->EventMask = mask;
+  RunPt->EventOptions = options;
+  ReadyRemove(RunPt);
+  WaitInsert(&groupPt->WaitPt, RunPt, SEMA4_FIFO);
+  ContextSwitch();
+  UnmaskInterrupts();     // switches here, OS_SetEvents makes it ready
+  return RunPt->EventMask;
+}
+
+#define FOREVER 0xFFFFFFFF  // time for SemaTake to block until it is signaled
+
+// ******** SemaTake ************
+// Decrement semaphore, block if less than zero, but for no more than a
+// time, called with interrupts disabled, which may be enabled while blocked
+// Inputs:  pointer to a semaphore
+//          msec to wait at most, 0 means do not block, FOREVER no limit
+// Outputs: 0 if decremented, -1 if the time ran out
+int static SemaTake(Sema4Type *semaPt, uint32_t time){
+  if(semaPt->Value > 0){
+    semaPt->Value = semaPt->Value - 1;
+    return 0;
+  }
+  if(time == 0){
+    return -1;
+  }
+  semaPt->Value = semaPt->Value - 1;
+  SemaBlock(&semaPt->Value, &semaPt->WaitPt, semaPt->Order);
+  if(time != FOREVER){
+    RunPt->TimeoutPt = semaPt;
+    SleepInsert(RunPt, time);    // first of SemaWake and runperiodicevents wakes it
+  }
+  UnmaskInterrupts();            // switches here, SemaBlock triggered PendSV
+  MaskInterrupts();
+  if(RunPt->TimeoutPt){
+    RunPt->TimeoutPt = 0;
+    return -1;                   // semaphore was not decremented
+  }
+  return 0;
+}
+
+// ******** SemaGive ************
+// Increment semaphore, wakeup the first blocked thread,
+// called with interrupts disabled
+// Inputs:  pointer to a semaphore
+// Outputs: none
+void static SemaGive(Sema4Type *semaPt){
+  semaPt->Value = semaPt->Value + 1;
+  if((semaPt->Value <= 0) && semaPt->WaitPt){
+    SemaWake(&semaPt->WaitPt);
+  }
+}
+
+// ******** QueueCopy ************
+// Copy one element into or out of a queue
+// Inputs:  destination, source, bytes
+// Outputs: none
+void static QueueCopy(uint8_t *to, const uint8_t *from, uint32_t size){
+  if(size == 4){
+    *(uint32_t *)to = *(const uint32_t *)from; // most elements are one word
+    return;
+  }
+  while(size){
+    *to++ = *from++;
+    size--;
+  }
+}
+
+// ******** QueueNext ************
+// Index after i, wrapping around without a division
+// Inputs:  pointer to a queue, index
+// Outputs: next index
+uint32_t static QueueNext(QueueType *queuePt, uint32_t i){
+  if(queuePt->Mask){
+    return (i+1)&queuePt->Mask;  // capacity is a power of 2
+  }
+  i++;
+  if(i == queuePt->Capacity){
+    i = 0;
+  }
+  return i;
+}
+
+// ******** OS_Queue_Init ************
+// Initialize a queue of fixed size elements, empty
+// Inputs:  pointer to a queue
+//          buffer for capacity elements, aligned for the element type
+//          bytes in each element
+//          number of elements, a power of 2 is faster
+// Outputs: none
+void OS_Queue_Init(QueueType *queuePt, void *buffer, uint32_t size, uint32_t capacity){
+  queuePt->Buffer = buffer;
+  queuePt->Size = size;
+  queuePt->Capacity = capacity;
+  if((capacity&(capacity-1)) == 0){
+    queuePt->Mask = capacity-1;
+  } else{
+    queuePt->Mask = 0;    // QueueNext compares instead
+  }
+  queuePt->PutI = queuePt->GetI = 0;
+  OS_InitSema4(&queuePt->Data, 0, SEMA4_PRIORITY);
+  OS_InitSema4(&queuePt->Room, capacity, SEMA4_PRIORITY);
+  queuePt->LostData = 0;
+}
+
+// ******** OS_Queue_Put ************
+// Put an element in a queue, blocking while it is full
+// Inputs:  pointer to a queue, pointer to the element
+// Outputs: none
+void OS_Queue_Put(QueueType *queuePt, const void *data){
+  OS_Queue_PutTimeout(queuePt, data, FOREVER);
+}
+
+// ******** OS_Queue_TryPut ************
+// Put an element in a queue if there is room, can be called from an
+// interrupt handler.  The element is lost, and counted, if it is full
+// Inputs:  pointer to a queue, pointer to the element
+// Outputs: 0 if successful, -1 if the queue is full
+int OS_Queue_TryPut(QueueType *queuePt, const void *data){
+  return OS_Queue_PutTimeout(queuePt, data, 0);
+}
+
+// ******** OS_Queue_PutTimeout ************
+// Put an element in a queue, blocking for no more than a time while
+// it is full.  The element is lost, and counted, if the time runs out
+// Inputs:  pointer to a queue, pointer to the element
+//          msec to wait at most, 0 means do not block
+// Outputs: 0 if successful, -1 if the queue stayed full
+int OS_Queue_PutTimeout(QueueType *queuePt, const void *data, uint32_t time){
+  MaskInterrupts();
+  if(SemaTake(&queuePt->Room, time)){
+    queuePt->LostData++;
+    TraceRecord(TRACE_DROP, (uintptr_t)queuePt);
+    UnmaskInterrupts();
+    return -1;
+  }
+  TraceRecord(TRACE_PUT, (uintptr_t)queuePt);
+  QueueCopy(&queuePt->Buffer[queuePt->PutI*queuePt->Size], data, queuePt->Size);
+  queuePt->PutI = QueueNext(queuePt, queuePt->PutI);
+  SemaGive(&queuePt->Data);
+  UnmaskInterrupts();
+  return 0;
+}
+
+// ******** QueueGet ************
+// Get an element from a queue, blocking for no more than a time
+// Inputs:  pointer to a queue, where to store the element
+//          msec to wait at most, 0 means do not block, FOREVER no limit
+// Outputs: 0 if successful, -1 if the queue stayed empty
+int static QueueGet(QueueType *queuePt, void *data, uint32_t time){
+  MaskInterrupts();
+  if(SemaTake(&queuePt->Data, time)){
+    UnmaskInterrupts();
+    return -1;
+  }
+  TraceRecord(TRACE_GET, (uintptr_t)queuePt);
+  QueueCopy(data, &queuePt->Buffer[queuePt->GetI*queuePt->Size], queuePt->Size);
+  queuePt->GetI = QueueNext(queuePt, queuePt->GetI);
+  SemaGive(&queuePt->Room);
+  UnmaskInterrupts();
+  return 0;
+}
+
+// ******** OS_Queue_Get ************
+// Get an element from a queue, blocking while it is empty
+// Inputs:  pointer to a queue, where to store the element
+// Outputs: none
+void OS_Queue_Get(QueueType *queuePt, void *data){
+  QueueGet(queuePt, data, FOREVER);
+}
+
+// ******** OS_Queue_TryGet ************
+// Get an element from a queue if it has one, without blocking
+// Inputs:  pointer to a queue, where to store the element
+// Outputs: 0 if successful, -1 if the queue is empty
+int OS_Queue_TryGet(QueueType *queuePt, void *data){
+  return QueueGet(queuePt, data, 0);
+}
+
+// ******** OS_Ring_Init ************
+// Initialize a single producer, single consumer ring, empty
+// Inputs:  pointer to a ring
+//          buffer for size words
+//          number of words, a power of 2
+// Outputs: none
+void OS_Ring_Init(RingType *ringPt, uint32_t *buffer, uint32_t size){
+  ringPt->Buffer = buffer;
+  ringPt->Mask = size-1;
+  ringPt->PutI = ringPt->GetI = 0;
+  ringPt->LostData = 0;
+  OS_InitSema4(&ringPt->Data, 0, SEMA4_FIFO);
+}
+
+// ******** OS_Ring_Put ************
+// Put a word in a ring without disabling interrupts.  Only the
+// producer writes PutI, and it is written after the data, so the
+// consumer never reads a word that is not there yet.  The consumer is
+// signaled only if it had taken everything, and so may be blocked,
+// so Data counts at most one signal.
+// Can be called from an interrupt handler, never blocks
+// Inputs:  pointer to a ring, data to store
+// Outputs: 0 if successful, -1 if the ring is full (data is lost)
+int OS_Ring_Put(RingType *ringPt, uint32_t data){
+  uint32_t putI = ringPt->PutI;
+  if((putI-ringPt->GetI) > ringPt->Mask){
+    ringPt->LostData++;
+    return -1;            // full
+  }
+  ringPt->Buffer[putI&ringPt->Mask] = data;
+  ringPt->PutI = putI+1;  // now the consumer can see it
+  if((ringPt->GetI == putI) && (ringPt->Data.Value <= 0)){
+    OS_SignalSema4(&ringPt->Data); // was empty, and no signal is waiting to be taken
+  }
+  return 0;
+}
+
+// ******** OS_Ring_GetN ************
+// Get up to max words from a ring, blocking while it is empty
+// Only the consumer writes GetI, after it has read the data
+// Inputs:  pointer to a ring
+//          where to store the words
+//          most words to get, at least 1
+// Outputs: number of words stored
+uint32_t OS_Ring_GetN(RingType *ringPt, uint32_t *data, uint32_t max){
+  uint32_t getI = ringPt->GetI;
+  uint32_t n,i;
+  while(ringPt->PutI == getI){
+    OS_WaitSema4(&ringPt->Data); // signals left from earlier puts just loop
+  }
+  n = ringPt->PutI-getI;
+  if(n > max){
+    n = max;
+  }
+  for(i=0; i<n; i++){
+    data[i] = ringPt->Buffer[(getI+i)&ringPt->Mask];
+  }
+  ringPt->GetI = getI+n;  // now the producer can reuse them
+  return n;
+}
+
+// ******** OS_Ring_Get ************
+// Get one word from a ring, blocking while it is empty
+// Inputs:  pointer to a ring
+// Outputs: data retrieved
+uint32_t OS_Ring_Get(RingType *ringPt){ uint32_t data;
+  OS_Ring_GetN(ringPt, &data, 1);
+  return data;
+}
+
+// the OS_FIFO of Lab 3 is one queue of 32-bit data
+#define FSIZE 16    // power of 2, so indices are masked
 uint32_t Fifo[FSIZE];
-int32_t CurrentSize;// 0 means FIFO empty, FSIZE means full
-uint32_t LostData;  // number of lost pieces of data
+QueueType FifoQueue;
 
 // ******** OS_FIFO_Init ************
 // Initialize FIFO.  The "put" and "get" indices initially
@@ -323,9 +1937,7 @@ void OS_FIFO_Init(void){
 // ****IMPLEMENT THIS****
 // Same as Lab 3
   	//---MyCode---
-	PutI = GetI = 0;		//Empty
-	OS_InitSemaphore(&CurrentSize, 0);
-	LostData = 0;
+	OS_Queue_Init(&FifoQueue, Fifo, sizeof(uint32_t), FSIZE);
 	//---MyCodeEnd---
 }
 
@@ -340,16 +1952,8 @@ int OS_FIFO_Put(uint32_t data){
 // ****IMPLEMENT THIS****
 // Same as Lab 3
 	//---MyCode---
-	if(CurrentSize == FSIZE){
-	LostData++;
-		return -1;			//Full
-	} else {
-		Fifo[PutI] = data;
-		PutI = (PutI+1)%FSIZE;
-		OS_Signal(&CurrentSize);
-	}
+	return OS_Queue_TryPut(&FifoQueue, &data);	//counted in FifoQueue.LostData if full
 	//---MyCodeEnd---
- return 0; // success
 }
 // ******** OS_FIFO_Get ************
 // Get an entry from the FIFO.  Consider using a unique
@@ -362,70 +1966,432 @@ uint32_t OS_FIFO_Get(void){uint32_t data;
 // ****IMPLEMENT THIS****
 // Same as Lab 3
 	//---MyCode---
-	OS_Wait(&CurrentSize);			//block if empty
-	data = Fifo[GetI];
-	GetI = (GetI+1)%FSIZE;			//place to get next
+	OS_Queue_Get(&FifoQueue, &data);	//block if empty
 	//---MyCodeEnd---
  return data;
 }
 // *****periodic events****************
-int32_t *PeriodicSemaphore0;
-uint32_t Period0; // time between signals
-int32_t *PeriodicSemaphore1;
-uint32_t Period1; // time between signals
-void RealTimeEvents(void){int flag=0;
-  static int32_t realCount = -10; // let all the threads execute once
-  // Note to students: we had to let the system run for a time so all user threads ran at least one
-  // before signalling the periodic tasks
-  realCount++;
-  if(realCount >= 0){
-    if((realCount%Period0)==0){
-      OS_Signal(PeriodicSemaphore0);
-      flag = 1;
-    }
-    if((realCount%Period1)==0){
-      OS_Signal(PeriodicSemaphore1);
-      flag=1;
+uint32_t RealTime;       // msec counted by RealTimeEvents
+uint32_t PeriodicSignalTime0; // DWT_CYCCNT when the first trigger added was last signaled, 0 without SIGNALTIMES
+
+// ******** TriggerInsert ************
+// Put a trigger into the list in order of release, after any
+// released at the same time, called with interrupts disabled
+// Inputs:  pointer to a trigger not in the list
+// Outputs: none
+void static TriggerInsert(struct trigger *trigPt){
+  struct trigger **linkPt = &TriggerPt;
+  while((*linkPt) && ((int32_t)((*linkPt)->Release-trigPt->Release) <= 0)){
+    linkPt = &((*linkPt)->Next);
+  }
+  trigPt->Next = *linkPt;
+  *linkPt = trigPt;
+}
+
+// signaled threads of higher priority than the one interrupted run
+// as soon as this returns, others wait for their turn
+void RealTimeEvents(void){
+  struct trigger *pt;
+  struct edge *edgePt;
+  OS_IsrEnter();
+  RealTime++;
+  if(Debouncing){
+    for(edgePt=Edges; edgePt<&Edges[NumEdges]; edgePt++){
+      if(edgePt->Count){
+        edgePt->Count--;
+        if(edgePt->Count == 0){
+          EdgeArm(edgePt);
+        }
+      }
     }
-    if(flag){
-      OS_Suspend();
+  }
+  while(TriggerPt && ((int32_t)(RealTime-TriggerPt->Release) >= 0)){
+    pt = TriggerPt;
+    TriggerPt = pt->Next;
+#if SIGNALTIMES
+    if(pt == &Triggers[0]){
+      PeriodicSignalTime0 = DWT_CYCCNT;
     }
+#endif
+    OS_Signal(pt->SemaPt);
+    pt->Release += pt->Period;   // no divide, the next release is known
+    TriggerInsert(pt);
   }
+  if(TimerPt && (TimerDue == 0) && ((int32_t)(RealTime-TimerPt->Expire) >= 0)){
+    TimerDue = 1;                // once, the timer thread runs all that are due
+    OS_Signal(&TimerSema);
+  }
+  OS_IsrExit();
+}
+
+// ******** RealTimeStart ************
+// Start the 1 kHz RealTimeEvents interrupt, for the first trigger or
+// the first edge event that debounces
+// Inputs:  none
+// Outputs: none
+void static RealTimeStart(void){
+  if(RealTimeOn == 0){
+    RealTimeOn = 1;
+    BSP_PeriodicTask_Init(&RealTimeEvents,1000,KERNELPRI);
+  }
+}
+
+// ******** OS_PeriodTrigger_Init ************
+// Signal a semaphore periodically from the 1 kHz RealTimeEvents
+// interrupt, started with the first trigger
+// Inputs:  semaphore to signal
+//          period in ms
+//          phase in ms, delay of the first signal
+// priority level KERNELPRI
+// Outputs: 1 if successful, 0 if NUMTRIGGERS are in use
+int OS_PeriodTrigger_Init(int32_t *semaPt, uint32_t period, uint32_t phase){
+  struct trigger *pt;
+  int status;
+  status = StartMask();
+  if(NumTriggers == NUMTRIGGERS){
+    EndMask(status);
+    return 0;
+  }
+  pt = &Triggers[NumTriggers];
+  pt->SemaPt = semaPt;
+  pt->Period = period;
+  // Note to students: we had to let the system run for a time so all user threads ran at least one
+  // before signalling the periodic tasks
+  pt->Release = RealTime+10+phase;
+  TriggerInsert(pt);
+  NumTriggers++;
+  EndMask(status);
+  RealTimeStart();
+  return 1;
 }
+
 //****NOTE: this uses PeriodicTimer, not PeriodicTimerC***********
 // ******** OS_PeriodTrigger0_Init ************
 // Initialize periodic timer interrupt to signal 
 // Inputs:  semaphore to signal
 //          period in ms
-// priority level at 0 (highest)
+// priority level KERNELPRI
 // Outputs: none
 void OS_PeriodTrigger0_Init(int32_t *semaPt, uint32_t period){
-  PeriodicSemaphore0 = semaPt;
-  Period0 = period;
-  BSP_PeriodicTask_Init(&RealTimeEvents,1000,0);
+  OS_PeriodTrigger_Init(semaPt, period, 0);
 }
 // ******** OS_PeriodTrigger1_Init ************
 // Initialize periodic timer interrupt to signal 
 // Inputs:  semaphore to signal
 //          period in ms
-// priority level at 0 (highest)
+// priority level KERNELPRI
 // Outputs: none
 void OS_PeriodTrigger1_Init(int32_t *semaPt, uint32_t period){
-  PeriodicSemaphore1 = semaPt;
-  Period1 = period;
-  BSP_PeriodicTask_Init(&RealTimeEvents,1000,0);
+  OS_PeriodTrigger_Init(semaPt, period, 0);
+}
+
+//****software timers************
+// ******** TimerInsert ************
+// Put a timer into the list in order of expiry, after any that
+// expire at the same time, called with interrupts masked
+// Inputs:  pointer to a timer not in the list
+// Outputs: none
+void static TimerInsert(TimerType *timerPt){
+  TimerType **linkPt = &TimerPt;
+  while((*linkPt) && ((int32_t)((*linkPt)->Expire-timerPt->Expire) <= 0)){
+    linkPt = &((*linkPt)->Next);
+  }
+  timerPt->Next = *linkPt;
+  *linkPt = timerPt;
+}
+
+// ******** TimerRemove ************
+// Take a started timer out of the list, called with interrupts masked
+// Inputs:  pointer to a timer in the list
+// Outputs: none
+void static TimerRemove(TimerType *timerPt){
+  TimerType **linkPt = &TimerPt;
+  while(*linkPt != timerPt){
+    linkPt = &((*linkPt)->Next);
+  }
+  *linkPt = timerPt->Next;
+}
+
+// ******** TimerThread ************
+// Kernel thread at TIMERPRIORITY, added by the first OS_Timer_Create
+// Runs the callbacks of the timers that are due, in order of expiry,
+// with interrupts enabled; a periodic timer is started again before
+// its callback runs, so the callback may stop it or change its period
+// Inputs:  none
+// Outputs: none
+void static TimerThread(void){
+  TimerType *pt;
+  for(;;){
+    OS_Wait(&TimerSema);
+    MaskInterrupts();
+    TimerDue = 0;
+    while(TimerPt && ((int32_t)(RealTime-TimerPt->Expire) >= 0)){
+      pt = TimerPt;
+      TimerPt = pt->Next;
+      if(pt->Period){
+        pt->Expire += pt->Period; // from the last expiry, so it does not drift
+        TimerInsert(pt);
+      } else{
+        pt->Active = 0;          // one-shot
+      }
+      UnmaskInterrupts();
+      pt->Task(pt);
+      MaskInterrupts();
+    }
+    UnmaskInterrupts();
+  }
+}
+
+// ******** OS_Timer_Create ************
+// Initialize a software timer, stopped; the first one adds the timer
+// thread that runs the callbacks
+// Inputs:  pointer to a timer
+//          function to call when it expires, gets the timer
+//          msec between calls once started, 0 for one-shot
+// Outputs: 1 if successful, 0 if the timer thread could not be added
+int OS_Timer_Create(TimerType *timerPt, void(*task)(TimerType *timerPt), uint32_t period){
+  uint32_t sr;
+  timerPt->Task = task;
+  timerPt->Period = period;
+  timerPt->Active = 0;
+  timerPt->Next = 0;
+  sr = StartMask();
+  if(TimerId == 0){
+    TimerSema = 0;         // not OS_InitSemaphore, which would unmask here
+    TimerId = OS_AddThreadEx(&TimerThread, TIMERPRIORITY, TIMERSTACK);
+  }
+  EndMask(sr);
+  return TimerId != 0;
+}
+
+// ******** OS_Timer_Start ************
+// Start a timer, or start it again if it is running
+// Inputs:  pointer to a timer from OS_Timer_Create
+//          msec until the first call, it runs delay to delay+1 msec from now
+// Outputs: none
+void OS_Timer_Start(TimerType *timerPt, uint32_t delay){
+  uint32_t sr = StartMask();
+  if(timerPt->Active){
+    TimerRemove(timerPt);
+  }
+  timerPt->Expire = RealTime+delay+1; // RealTime counts at the end of each msec
+  timerPt->Active = 1;
+  TimerInsert(timerPt);
+  EndMask(sr);
+  RealTimeStart();
+}
+
+// ******** OS_Timer_Stop ************
+// Stop a timer, its callback is not called until it is started again
+// Inputs:  pointer to a timer from OS_Timer_Create
+// Outputs: none
+void OS_Timer_Stop(TimerType *timerPt){
+  uint32_t sr = StartMask();
+  if(timerPt->Active){
+    TimerRemove(timerPt);
+    timerPt->Active = 0;
+  }
+  EndMask(sr);
+}
+
+// ******** OS_Timer_SetPeriod ************
+// Change the period of a timer; its next call stays when it is due,
+// the new period counts from that call
+// Inputs:  pointer to a timer from OS_Timer_Create
+//          msec between calls, 0 makes it stop after the next call
+// Outputs: none
+void OS_Timer_SetPeriod(TimerType *timerPt, uint32_t period){
+  timerPt->Period = period;  // read by the timer thread with interrupts masked
 }
 
 //****edge-triggered event************
-int32_t *edgeSemaphore;
+// the registers of a GPIO port, as word offsets from its first address
+#define PORT_DATA   (0x3FC/4)  // all eight pins
+#define PORT_IS     (0x404/4)
+#define PORT_IBE    (0x408/4)
+#define PORT_IEV    (0x40C/4)
+#define PORT_IM     (0x410/4)
+#define PORT_RIS    (0x414/4)
+#define PORT_ICR    (0x41C/4)
+volatile uint32_t * const GpioPort[6] = GPIOPORTS;
+uint8_t const PortIrq[6] = {0, 1, 2, 3, 4, 30}; // interrupt numbers of ports A to F
+volatile uint32_t * const PortPri[6] = {&NVIC_PRI0_R, &NVIC_PRI0_R, &NVIC_PRI0_R,
+                                        &NVIC_PRI0_R, &NVIC_PRI1_R, &NVIC_PRI7_R};
+
+// ******** EdgeReport ************
+// Signal the semaphore and set the flags of an edge event, if a
+// debounced pin changed to Level in the direction asked for
+// A thread woken up preempts the one interrupted only if it has higher priority
+// Inputs:  pointer to the edge event
+// Outputs: none
+void static EdgeReport(struct edge *pt){
+  if(pt->Debounce && ((pt->Edges&(pt->Level ? EDGE_RISING : EDGE_FALLING)) == 0)){
+    return;
+  }
+#if SIGNALTIMES
+  EdgeSignalTime = DWT_CYCCNT;
+#endif
+  if(pt->SemaPt){
+    OS_Signal(pt->SemaPt);
+  }
+  if(pt->EventPt){
+    OS_SetEvents(pt->EventPt, pt->Flags);
+  }
+}
+
+// ******** EdgeHandler ************
+// Report the edges on the pins of a port, and disarm those that
+// debounce until RealTimeEvents arms them again.  Those interrupt on
+// both edges, so each edge changes their level
+// Inputs:  port 0 to 5 for A to F
+// Outputs: none
+void static EdgeHandler(uint32_t port){
+  volatile uint32_t *gpio = GpioPort[port];
+  struct edge *pt;
+  uint32_t bits,sr;
+  OS_IsrEnter();
+  bits = gpio[PORT_RIS]&gpio[PORT_IM];
+  gpio[PORT_ICR] = bits;         // acknowledge
+  for(pt=Edges; pt<&Edges[NumEdges]; pt++){
+    if((pt->Port == port) && (bits&pt->Bit)){
+      if(pt->Debounce){
+        sr = StartMask();        // RealTimeEvents arms other pins of the port
+        gpio[PORT_IM] &= ~pt->Bit; // the bounces that follow are not edges
+        pt->Count = pt->Debounce;
+        Debouncing++;
+        EndMask(sr);
+      }
+      pt->Level ^= pt->Bit;
+      EdgeReport(pt);
+    }
+  }
+  OS_IsrExit();
+}
+
+// ******** EdgeArm ************
+// Arm a pin again once its debounce time is up, called by RealTimeEvents
+// Edges while it was disarmed are dropped, but if the pin is no longer
+// at the level of the last edge, it changed back meanwhile, and that
+// edge is reported now and debounced again
+// Inputs:  pointer to the edge event
+// Outputs: none
+void static EdgeArm(struct edge *pt){
+  volatile uint32_t *gpio = GpioPort[pt->Port];
+  uint32_t sr = StartMask();
+  gpio[PORT_ICR] = pt->Bit;      // bounces while it was disarmed
+  if((gpio[PORT_DATA]&pt->Bit) != pt->Level){
+    pt->Level ^= pt->Bit;
+    pt->Count = pt->Debounce;
+    EndMask(sr);
+    EdgeReport(pt);
+    return;
+  }
+  gpio[PORT_IM] |= pt->Bit;      // an edge since the ICR write interrupts now
+  Debouncing--;
+  EndMask(sr);
+}
+
+// ******** EdgeAdd ************
+// Set up an edge event, for OS_EdgeSema_Init and OS_EdgeEvents_Init
+// Inputs:  pin, edges, debounce and priority as OS_EdgeSema_Init
+//          semaphore to signal, 0 for none
+//          event group and flags to set, 0 for none
+// Outputs: 1 if successful, 0 if not
+int static EdgeAdd(uint32_t pin, uint32_t edges, uint32_t debounce, uint32_t priority,
+                   int32_t *semaPt, EventGroupType *groupPt, uint32_t flags){
+  struct edge *pt;
+  volatile uint32_t *gpio;
+  uint32_t port = pin>>3;
+  uint32_t bit = 1<<(pin&7);
+  uint32_t shift,sr;
+  if((port > 5) || (edges == 0) || (edges > EDGE_BOTH)){
+    return 0;
+  }
+  if(priority < KERNELPRI){
+    priority = KERNELPRI;        // EdgeHandler calls OS_Signal
+  }
+  if(priority > 7){
+    priority = 7;
+  }
+  sr = StartMask();
+  if(NumEdges == NUMEDGES){
+    EndMask(sr);
+    return 0;
+  }
+  pt = &Edges[NumEdges];
+  pt->Port = port;
+  pt->Bit = bit;
+  pt->Edges = edges;
+  pt->Debounce = debounce;
+  pt->Count = 0;
+  pt->SemaPt = semaPt;
+  pt->EventPt = groupPt;
+  pt->Flags = flags;
+  SYSCTL_RCGCGPIO_R |= 1<<port;  // activate clock for the port
+  while((SYSCTL_PRGPIO_R&(1<<port)) == 0){};
+  gpio = GpioPort[port];
+  gpio[PORT_IS] &= ~bit;         // edge-sensitive
+  if(debounce || (edges == EDGE_BOTH)){
+    gpio[PORT_IBE] |= bit;
+  } else{
+    gpio[PORT_IBE] &= ~bit;
+    if(edges == EDGE_RISING){
+      gpio[PORT_IEV] |= bit;
+    } else{
+      gpio[PORT_IEV] &= ~bit;
+    }
+  }
+  pt->Level = gpio[PORT_DATA]&bit;
+  gpio[PORT_ICR] = bit;          // clear flag
+  gpio[PORT_IM] |= bit;          // arm interrupt
+  shift = (PortIrq[port]&3)*8+5; // priority is in bits 7-5 of its byte
+  *PortPri[port] = (*PortPri[port]&~(7<<shift))|(priority<<shift);
+  NVIC_EN0_R = 1<<PortIrq[port];
+  NumEdges++;                    // EdgeHandler sees it from now on
+  EndMask(sr);
+  if(debounce){
+    RealTimeStart();             // counts down the debounce time
+  }
+  return 1;
+}
+
+// ******** OS_EdgeSema_Init ************
+// Signal a semaphore on edges of an input pin.  After each edge the pin
+// is disarmed for the debounce time, counted by RealTimeEvents, so its
+// bounces are not edges; if the pin came back meanwhile, that edge is
+// signaled when the time is up.  A debounced pin interrupts on both
+// edges, so a bounce on release is not taken for a falling edge.  The
+// pin must already be a digital input (BSP_Button1_Init,
+// BSP_Button2_Init, BSP_Joystick_Init)
+// Inputs:  pin, OS_PIN('D',6) is PD6
+//          EDGE_FALLING, EDGE_RISING or EDGE_BOTH
+//          debounce time in msec, 0 for none
+//          semaphore to signal
+//          priority of the port interrupt, KERNELPRI to 7, the pins of a
+//          port share it
+// Outputs: 1 if successful, 0 if NUMEDGES pins have edge events or no such pin
+int OS_EdgeSema_Init(uint32_t pin, uint32_t edges, uint32_t debounce, int32_t *semaPt, uint32_t priority){
+  return EdgeAdd(pin, edges, debounce, priority, semaPt, 0, 0);
+}
+
+// ******** OS_EdgeEvents_Init ************
+// Set flags in an event group on edges of an input pin, debounced
+// the same way as OS_EdgeSema_Init
+// Inputs:  pin, edges, debounce time as OS_EdgeSema_Init
+//          event group, and the flags to set
+//          priority of the port interrupt, KERNELPRI to 7
+// Outputs: 1 if successful, 0 if NUMEDGES pins have edge events or no such pin
+int OS_EdgeEvents_Init(uint32_t pin, uint32_t edges, uint32_t debounce, EventGroupType *groupPt, uint32_t flags, uint32_t priority){
+  return EdgeAdd(pin, edges, debounce, priority, 0, groupPt, flags);
+}
+
 // ******** OS_EdgeTrigger_Init ************
-// Initialize button1, PD6, to signal on a falling edge interrupt
+// Initialize button1, PD6, to signal on a falling edge interrupt,
+// debounced for EDGEDEBOUNCE msec
 // Inputs:  semaphore to signal
-//          priority
+//          priority, KERNELPRI to 7, higher ones are lowered to KERNELPRI
 // Outputs: none
 void OS_EdgeTrigger_Init(int32_t *semaPt, uint8_t priority){
-	edgeSemaphore = semaPt;
-//***IMPLEMENT THIS***
 SYSCTL_RCGCGPIO_R |= 0x08;			// 1) activate clock for Port D	(Check page 340 of the datasheet)
 while((SYSCTL_PRGPIO_R&0x08) == 0){};								// allow time for clock to stabilize
 																// 2) no need to unlock PD6
@@ -436,33 +2402,34 @@ GPIO_PORTD_DIR_R &= ~0x40; 			// 5) make PD6 input
 GPIO_PORTD_AFSEL_R &= ~0x40;			// 6) disable alt funct on PD6
 GPIO_PORTD_PUR_R &= ~0x40;			 	// disable pull-up on PD6
 GPIO_PORTD_DEN_R |= 0x40;				// 7) enable digital I/O on PD6  
-GPIO_PORTD_IS_R &= ~0x40;				// (d) PD6 is edge-sensitive 
-GPIO_PORTD_IBE_R &= ~0x40;				//     PD6 is not both edges 
-GPIO_PORTD_IEV_R &= ~0x40;				//     PD6 is falling edge event 
-GPIO_PORTD_ICR_R = 0x40;				// (e) clear PD6 flag
-GPIO_PORTD_IM_R |= 0x40;				// (f) arm interrupt on PD6
-NVIC_PRI0_R = (NVIC_PRI0_R&0x1FFFFFFF)|(priority << 29);		// priority on Port D edge trigger is NVIC_PRI0_R	31 – 29
-NVIC_EN0_R = 0x08; 							// enable is bit 3 in NVIC_EN0_R
- }
+  OS_EdgeSema_Init(OS_PIN('D',6), EDGE_FALLING, EDGEDEBOUNCE, semaPt, priority);
+}
 
 // ******** OS_EdgeTrigger_Restart ************
-// restart button1 to signal on a falling edge interrupt
-// rearm interrupt
+// Nothing to do, the kernel arms PD6 again after the debounce time;
+// kept for programs that call it after each edge
 // Inputs:  none
 // Outputs: none
 void OS_EdgeTrigger_Restart(void){
-//***IMPLEMENT THIS***
-GPIO_PORTD_IM_R |= 0x40;					// rearm interrupt 3 in NVIC
-GPIO_PORTD_ICR_R	= 0x40;				// clear flag6
+}
+
+void GPIOPortA_Handler(void){
+  EdgeHandler(0);
+}
+void GPIOPortB_Handler(void){
+  EdgeHandler(1);
+}
+void GPIOPortC_Handler(void){
+  EdgeHandler(2);
 }
 void GPIOPortD_Handler(void){
-//***IMPLEMENT THIS***
-if(GPIO_PORTD_RIS_R & 0x40){			//if  an interrupt condition has occurred	
-	GPIO_PORTD_ICR_R	= 0x40;			// step 1 acknowledge by clearing flag
-  OS_Signal(edgeSemaphore);			// step 2 signal semaphore (no need to run scheduler)
-  GPIO_PORTD_IM_R &= ~0x40;				// step 3 disarm interrupt to prevent bouncing to create multiple signals
+  EdgeHandler(3);
+}
+void GPIOPortE_Handler(void){
+  EdgeHandler(4);
 }
-OS_Suspend();
+void GPIOPortF_Handler(void){
+  EdgeHandler(5);
 }
 
 
@@ -28,6 +28,14 @@
 #ifndef __OS_H
 #define __OS_H  1
 
+// Interrupts of priority KERNELPRI to 7 may call the OS, and the kernel
+// holds them pending in its critical sections (BASEPRI).  Interrupts of
+// priority 0 to KERNELPRI-1 are never delayed by the kernel, and must
+// not call it.  The kernel's own interrupts run at KERNELPRI.
+#ifndef KERNELPRI
+#define KERNELPRI 1
+#endif
+
 
 // ******** OS_Init ************
 // Initialize operating system, disable interrupts
@@ -41,19 +49,138 @@ void OS_Init(void);
 //******** OS_AddThread *************** 
 // add a foregound thread to the scheduler
 // Inputs: pointer to a void/void foreground function
-//         priority (0 is highest)
+//         priority (0 is highest, 30 is lowest, 31 and up mean 30)
 // Outputs: Thread ID if successful, 0 if this thread can not be added
 // stack size must be divisable by 8 (aligned to double word boundary)
 int OS_AddThread(void(*task)(void), uint32_t priority);
 
+//******** OS_AddThreadEx *************** 
+// add a foregound thread to the scheduler, with its stack from the pool
+// Inputs: pointer to a void/void foreground function
+//         priority (0 is highest, 30 is lowest, 31 and up mean 30)
+//         number of bytes in its stack, rounded up to a multiple of 8
+// Outputs: Thread ID if successful, 0 if this thread can not be added
+// OS_Kill returns the stack to the pool
+int OS_AddThreadEx(void(*task)(void), uint32_t priority, uint32_t stackBytes);
+
+//******** OS_AddEdfThread *************** 
+// add a foregound thread scheduled earliest deadline first, with its
+// stack from the pool
+// EDF threads all run at one fixed priority, EDFPRIORITY in os.c (4);
+// among them the one whose current job is due first runs, and threads
+// of higher priority still preempt them
+// Inputs: pointer to a void/void foreground function, that calls
+//         OS_EdfWait at the end of each job
+//         period in msec, 1 to 10000
+//         relative deadline in msec, 1 to 10000
+//         number of bytes in its stack, rounded up to a multiple of 8
+// Outputs: Thread ID if successful, 0 if this thread can not be added
+int OS_AddEdfThread(void(*task)(void), uint32_t period, uint32_t deadline, uint32_t stackBytes);
+
+// ******** OS_EdfWait ************
+// End the current job of the running EDF thread and wait for the next
+// release, one period after this one; a job that ends after its deadline
+// is counted as a miss, and if the next job is already late it is
+// released right away
+// Inputs:  none
+// Outputs: none
+void OS_EdfWait(void);
+
+// ******** OS_DeadlineMisses ************
+// Number of jobs of an EDF thread that finished after their deadline
+// Inputs:  Thread Id, from OS_AddEdfThread or OS_Id
+// Outputs: misses since it was added, -1 if there is no thread with that Id
+int32_t OS_DeadlineMisses(uint32_t id);
+
+// CPU use of one thread, from OS_GetStats
+struct ThreadStats{
+  uint32_t Id;         // thread Id
+  void(*Task)(void);   // function it was added with
+  uint32_t Priority;   // priority it runs at now
+  uint32_t Percent;    // CPU time, in 0.01%, not counting interrupts
+  uint32_t Switches;   // times it was switched in
+  uint32_t MaxBurst;   // most bus cycles it ran without being switched out
+};
+typedef struct ThreadStats ThreadStatsType;
+
+// ******** OS_GetStats ************
+// CPU use of each thread since the last call, or since OS_Launch,
+// then start counting again; calls must be less than 53 s apart at 80 MHz
+// Inputs:  array to fill, one entry per thread
+//          number of entries in the array
+//          where to put the time in interrupts, in 0.01%, counting the
+//          kernel interrupts and those that call OS_IsrEnter and OS_IsrExit
+// Outputs: number of entries filled, 0 if os.c is built without CPUSTATS
+int OS_GetStats(ThreadStatsType *stats, int max, uint32_t *isrPercent);
+
+// ******** OS_IsrEnter ************
+// Start counting time in an interrupt, so OS_GetStats does not charge
+// it to the thread it interrupted; call first thing in the handler
+// Inputs:  none
+// Outputs: none
+void OS_IsrEnter(void);
+
+// ******** OS_IsrExit ************
+// Stop counting time in an interrupt, call last thing in the handler
+// Inputs:  none
+// Outputs: none
+void OS_IsrExit(void);
+
+// ******** OS_MaskStats ************
+// Longest time the kernel held the interrupts of priority KERNELPRI
+// to 7 pending since the last call, then start again; only counted
+// if os.c is built with MASKSTATS 1
+// Inputs:  where to put the lines of os.c that masked and unmasked
+// Outputs: bus cycles, 0 without MASKSTATS
+uint32_t OS_MaskStats(uint32_t *startLine, uint32_t *endLine);
+
+// kernel events recorded for OS_TraceDump, each with the DWT_CYCCNT
+// time, the low 8 bits of the Id of the thread running (or interrupted)
+// and an Arg; a semaphore or queue Arg is the low 16 bits of its address
+#define TRACE_SWITCH   1  // switched out, Arg is the Id of the thread switched in
+#define TRACE_WAIT     2  // OS_Wait or OS_WaitSema4, Arg is the semaphore
+#define TRACE_BLOCK    3  // blocked on the semaphore Arg, queues block on theirs
+#define TRACE_SIGNAL   4  // OS_Signal or OS_SignalSema4, Arg is the semaphore
+#define TRACE_PUT      5  // element put in the queue Arg, OS_FIFO_Put too
+#define TRACE_GET      6  // element taken from the queue Arg
+#define TRACE_DROP     7  // element lost, the queue Arg was full
+#define TRACE_SLEEP    8  // OS_Sleep, Arg is the msec
+#define TRACE_KILL     9  // OS_Kill
+#define TRACE_ISRENTER 10 // OS_IsrEnter
+#define TRACE_ISREXIT  11 // OS_IsrExit
+
+// ******** OS_TraceDump ************
+// Send the kernel events recorded since the last call, or since OS_Init,
+// oldest first, then the threads alive; recording stops while they are
+// sent and starts again empty.  Only the last 256 are kept.  Needs TRACE 1
+// in os.c, HostPort/tracejson turns the lines into a Chrome trace
+//   trace,<bus Hz>,<events written over>
+//   <DWT_CYCCNT>,<TRACE_ event>,<Id>,<Arg>   one per event
+//   thread,<Id>,<task address>,<priority>   one per thread
+//   end
+// all numbers in hex
+// Inputs:  function that sends one character, like UART0_OutChar
+// Outputs: number of events sent, 0 without TRACE
+uint32_t OS_TraceDump(void(*outChar)(char));
+
 // ****OS_Id**********
 // returns the Id for the currently running thread
 // Input:  none
 // Output: Thread Id (1 to NUMTHREADS)
 uint32_t OS_Id(void);
 
+// ******** OS_StackUsed ************
+// Most stack a thread has used since it was added, found by
+// looking for the lowest word that no longer holds STACKPAINT
+// Inputs:  Thread Id, from OS_AddThread or OS_Id
+// Outputs: peak bytes used, including the frame saved when it is
+//          switched out, -1 if there is no thread with that Id
+int32_t OS_StackUsed(uint32_t id);
+
 //******** OS_Launch ***************
 // Start the scheduler, enable interrupts
+// Adds the kernel idle thread at priority 31, which stops SysTick and
+// sleeps the processor (WFI) while no other thread is ready
 // Inputs: number of clock cycles for each time slice
 // Outputs: none (does not return)
 // Errors: theTimeSlice must be less than 16,777,216
@@ -103,6 +230,215 @@ void OS_Wait(int32_t *semaPt);
 // Outputs: none
 void OS_Signal(int32_t *semaPt);
 
+// counting semaphore that keeps its own list of blocked threads,
+// so OS_SignalSema4 wakes a thread without searching
+struct Sema4{
+  int32_t Value;      // count, -n means n threads are blocked
+  uint32_t Order;     // SEMA4_FIFO or SEMA4_PRIORITY
+  struct tcb *WaitPt; // last thread to wake up, 0 if none blocked
+};
+typedef struct Sema4 Sema4Type;
+#define SEMA4_FIFO     0  // wake threads in the order they blocked
+#define SEMA4_PRIORITY 1  // wake highest priority first, FIFO if equal
+
+// ******** OS_InitSema4 ************
+// Initialize a counting semaphore with its own wait list
+// Inputs:  pointer to a semaphore
+//          initial value of semaphore
+//          SEMA4_FIFO or SEMA4_PRIORITY
+// Outputs: none
+void OS_InitSema4(Sema4Type *semaPt, int32_t value, uint32_t order);
+
+// ******** OS_WaitSema4 ************
+// Decrement semaphore and block if less than zero
+// Inputs:  pointer to a semaphore
+// Outputs: none
+void OS_WaitSema4(Sema4Type *semaPt);
+
+// ******** OS_SignalSema4 ************
+// Increment semaphore, wakeup the first blocked thread
+// Inputs:  pointer to a semaphore
+// Outputs: none
+void OS_SignalSema4(Sema4Type *semaPt);
+
+// mutual exclusion lock with an owner, only the owner may unlock it
+// While a higher priority thread is blocked on it, the owner runs at
+// that thread's priority (priority inheritance)
+struct Mutex{
+  struct tcb *Owner;      // thread that locked it, 0 if free
+  uint32_t Count;         // times Owner has locked it
+  struct tcb *WaitPt;     // last thread to get it, 0 if none blocked
+  struct Mutex *NextHeld; // next mutex owned by the same thread
+};
+typedef struct Mutex MutexType;
+
+// ******** OS_InitMutex ************
+// Initialize a mutex, not locked
+// Inputs:  pointer to a mutex
+// Outputs: none
+void OS_InitMutex(MutexType *mutexPt);
+
+// ******** OS_LockMutex ************
+// Lock a mutex, blocking while another thread owns it
+// The owner inherits the priority of the highest thread blocked, so the
+// time blocked is bounded by the critical sections of lower threads
+// The owner may lock it again, it must unlock as many times
+// Before OS_Launch it does nothing, so main can share code with threads
+// Inputs:  pointer to a mutex
+// Outputs: none
+void OS_LockMutex(MutexType *mutexPt);
+
+// ******** OS_UnlockMutex ************
+// Unlock a mutex, the highest priority thread blocked on it becomes
+// the owner, and the running thread drops any priority it inherited
+// Inputs:  pointer to a mutex
+// Outputs: 0 if successful, -1 if the running thread does not own it
+int OS_UnlockMutex(MutexType *mutexPt);
+
+// 32 event flags, threads wait for any or all of a set of them,
+// so one thread can serve several interrupts or other threads
+struct EventGroup{
+  uint32_t Flags;         // flags that are set
+  struct tcb *WaitPt;     // last thread to block, 0 if none blocked
+};
+typedef struct EventGroup EventGroupType;
+#define EVENT_ANY   0     // wait until any flag in the mask is set
+#define EVENT_ALL   1     // wait until all flags in the mask are set
+#define EVENT_CLEAR 2     // add to clear the flags in the mask when the wait ends
+
+// ******** OS_InitEventGroup ************
+// Initialize a group of 32 event flags
+// Inputs:  pointer to an event group
+//          flags that start out set
+// Outputs: none
+void OS_InitEventGroup(EventGroupType *groupPt, uint32_t flags);
+
+// ******** OS_SetEvents ************
+// Set event flags, and wake up every thread whose wait is now over,
+// in the order they blocked
+// Can be called from an interrupt handler
+// Inputs:  pointer to an event group
+//          flags to set
+// Outputs: none
+void OS_SetEvents(EventGroupType *groupPt, uint32_t flags);
+
+// ******** OS_ClearEvents ************
+// Clear event flags
+// Inputs:  pointer to an event group
+//          flags to clear
+// Outputs: none
+void OS_ClearEvents(EventGroupType *groupPt, uint32_t flags);
+
+// ******** OS_WaitEvents ************
+// Block until any or all of the flags in a mask are set
+// Inputs:  pointer to an event group
+//          flags to wait for
+//          EVENT_ANY or EVENT_ALL, plus EVENT_CLEAR to clear the
+//          flags in the mask when the wait is over
+// Outputs: the flags in the mask that were set when the wait ended
+uint32_t OS_WaitEvents(EventGroupType *groupPt, uint32_t mask, uint32_t options);
+
+// queue of fixed size elements in a buffer given by the caller,
+// any number of producers and consumers, each queue is separate
+struct Queue{
+  uint8_t *Buffer;    // Capacity elements of Size bytes
+  uint32_t Size;      // bytes in each element
+  uint32_t Capacity;  // number of elements in Buffer
+  uint32_t Mask;      // Capacity-1 if it is a power of 2, else 0
+  uint32_t PutI;      // index of where to put next
+  uint32_t GetI;      // index of where to get next
+  Sema4Type Data;     // elements in the queue, consumers block on it
+  Sema4Type Room;     // free elements, producers block on it
+  uint32_t LostData;  // elements not stored because the queue was full
+};
+typedef struct Queue QueueType;
+
+// ******** OS_Queue_Init ************
+// Initialize a queue of fixed size elements, empty
+// Inputs:  pointer to a queue
+//          buffer for capacity elements, aligned for the element type
+//          bytes in each element
+//          number of elements, a power of 2 is faster
+// Outputs: none
+void OS_Queue_Init(QueueType *queuePt, void *buffer, uint32_t size, uint32_t capacity);
+
+// ******** OS_Queue_Put ************
+// Put an element in a queue, blocking while it is full
+// Inputs:  pointer to a queue, pointer to the element
+// Outputs: none
+void OS_Queue_Put(QueueType *queuePt, const void *data);
+
+// ******** OS_Queue_TryPut ************
+// Put an element in a queue if there is room, can be called from an
+// interrupt handler.  The element is lost, and counted, if it is full
+// Inputs:  pointer to a queue, pointer to the element
+// Outputs: 0 if successful, -1 if the queue is full
+int OS_Queue_TryPut(QueueType *queuePt, const void *data);
+
+// ******** OS_Queue_PutTimeout ************
+// Put an element in a queue, blocking for no more than a time while
+// it is full.  The element is lost, and counted, if the time runs out
+// Inputs:  pointer to a queue, pointer to the element
+//          msec to wait at most, 0 means do not block
+// Outputs: 0 if successful, -1 if the queue stayed full
+int OS_Queue_PutTimeout(QueueType *queuePt, const void *data, uint32_t time);
+
+// ******** OS_Queue_Get ************
+// Get an element from a queue, blocking while it is empty
+// Inputs:  pointer to a queue, where to store the element
+// Outputs: none
+void OS_Queue_Get(QueueType *queuePt, void *data);
+
+// ******** OS_Queue_TryGet ************
+// Get an element from a queue if it has one, without blocking
+// Inputs:  pointer to a queue, where to store the element
+// Outputs: 0 if successful, -1 if the queue is empty
+int OS_Queue_TryGet(QueueType *queuePt, void *data);
+
+// ring of words for one producer, often an interrupt handler, and one
+// consumer thread, with no critical sections.  PutI and GetI count up
+// forever and are masked, the producer writes only PutI and the
+// consumer only GetI.  On the Cortex-M4 loads and stores to memory
+// are done in program order, so volatile is all that is needed.
+struct Ring{
+  volatile uint32_t *Buffer; // Mask+1 words
+  uint32_t Mask;      // number of words-1, a power of 2 minus 1
+  volatile uint32_t PutI; // words put since it was initialized
+  volatile uint32_t GetI; // words gotten since it was initialized
+  uint32_t LostData;  // words not stored because the ring was full
+  Sema4Type Data;     // signaled when a word is put in an empty ring
+};
+typedef struct Ring RingType;
+
+// ******** OS_Ring_Init ************
+// Initialize a single producer, single consumer ring, empty
+// Inputs:  pointer to a ring
+//          buffer for size words
+//          number of words, a power of 2
+// Outputs: none
+void OS_Ring_Init(RingType *ringPt, uint32_t *buffer, uint32_t size);
+
+// ******** OS_Ring_Put ************
+// Put a word in a ring without disabling interrupts
+// Can be called from an interrupt handler, never blocks
+// Inputs:  pointer to a ring, data to store
+// Outputs: 0 if successful, -1 if the ring is full (data is lost)
+int OS_Ring_Put(RingType *ringPt, uint32_t data);
+
+// ******** OS_Ring_GetN ************
+// Get up to max words from a ring, blocking while it is empty
+// Inputs:  pointer to a ring
+//          where to store the words
+//          most words to get, at least 1
+// Outputs: number of words stored
+uint32_t OS_Ring_GetN(RingType *ringPt, uint32_t *data, uint32_t max);
+
+// ******** OS_Ring_Get ************
+// Get one word from a ring, blocking while it is empty
+// Inputs:  pointer to a ring
+// Outputs: data retrieved
+uint32_t OS_Ring_Get(RingType *ringPt);
+
 // ******** OS_FIFO_Init ************
 // Initialize FIFO.  The "put" and "get" indices initially
 // are equal, which means that the FIFO is empty.  Also
@@ -132,11 +468,21 @@ int OS_FIFO_Put(uint32_t data);
 // Outputs: data retrieved
 uint32_t OS_FIFO_Get(void);
 
+// ******** OS_PeriodTrigger_Init ************
+// Signal a semaphore periodically from the 1 kHz RealTimeEvents
+// interrupt, started with the first trigger
+// Inputs:  semaphore to signal
+//          period in ms
+//          phase in ms, delay of the first signal
+// priority level KERNELPRI
+// Outputs: 1 if successful, 0 if NUMTRIGGERS are in use
+int OS_PeriodTrigger_Init(int32_t *semaPt, uint32_t period, uint32_t phase);
+
 // ******** OS_PeriodTrigger0_Init ************
 // Initialize periodic timer interrupt to signal 
 // Inputs:  semaphore to signal
 //          period in ms
-// priority level at 0 (highest)
+// priority level KERNELPRI
 // Outputs: none
 void OS_PeriodTrigger0_Init(int32_t *semaPt, uint32_t period);
 
@@ -144,20 +490,98 @@ void OS_PeriodTrigger0_Init(int32_t *semaPt, uint32_t period);
 // Initialize periodic timer interrupt to signal 
 // Inputs:  semaphore to signal
 //          period in ms
-// priority level at 0 (highest)
+// priority level KERNELPRI
 // Outputs: none
 void OS_PeriodTrigger1_Init(int32_t *semaPt, uint32_t period);
 
+// software timers, the callbacks run one at a time in a kernel thread
+// of priority TIMERPRIORITY in os.c (0), in order of expiry, so a
+// callback should be short and not block
+struct Timer{
+  void(*Task)(struct Timer *timerPt); // callback, gets the timer that expired
+  uint32_t Period;     // msec between calls, 0 for one-shot
+  uint32_t Expire;     // msec count of the next call
+  uint32_t Active;     // nonzero while started
+  struct Timer *Next;  // timer that expires after this one
+};
+typedef struct Timer TimerType;
+
+// ******** OS_Timer_Create ************
+// Initialize a software timer, stopped; the first one adds the timer
+// thread that runs the callbacks
+// Inputs:  pointer to a timer
+//          function to call when it expires, gets the timer
+//          msec between calls once started, 0 for one-shot
+// Outputs: 1 if successful, 0 if the timer thread could not be added
+int OS_Timer_Create(TimerType *timerPt, void(*task)(TimerType *timerPt), uint32_t period);
+
+// ******** OS_Timer_Start ************
+// Start a timer, or start it again if it is running
+// Inputs:  pointer to a timer from OS_Timer_Create
+//          msec until the first call, it runs delay to delay+1 msec from now
+// Outputs: none
+void OS_Timer_Start(TimerType *timerPt, uint32_t delay);
+
+// ******** OS_Timer_Stop ************
+// Stop a timer, its callback is not called until it is started again
+// Inputs:  pointer to a timer from OS_Timer_Create
+// Outputs: none
+void OS_Timer_Stop(TimerType *timerPt);
+
+// ******** OS_Timer_SetPeriod ************
+// Change the period of a timer; its next call stays when it is due,
+// the new period counts from that call
+// Inputs:  pointer to a timer from OS_Timer_Create
+//          msec between calls, 0 makes it stop after the next call
+// Outputs: none
+void OS_Timer_SetPeriod(TimerType *timerPt, uint32_t period);
+
+// pins for the edge events, port 'A' to 'F' and bit 0 to 7; on the
+// MKII, button 1 is OS_PIN('D',6), button 2 is OS_PIN('D',7), and the
+// joystick select is OS_PIN('E',4)
+#define OS_PIN(port,bit) ((((port)-'A')<<3)+(bit))
+#define EDGE_FALLING 1
+#define EDGE_RISING  2
+#define EDGE_BOTH    3
+
+// ******** OS_EdgeSema_Init ************
+// Signal a semaphore on edges of an input pin.  After each edge the pin
+// is disarmed for the debounce time, counted by the kernel's 1 kHz
+// RealTimeEvents, so its bounces are not edges; if the pin came back
+// meanwhile, that edge is signaled when the time is up.  A debounced
+// pin interrupts on both edges, so a bounce on release is not taken
+// for a falling edge.  A thread woken up preempts only if it has
+// higher priority than the one interrupted.  The pin must already be
+// a digital input (BSP_Button1_Init, BSP_Button2_Init, BSP_Joystick_Init)
+// Inputs:  pin, OS_PIN('D',6) is PD6
+//          EDGE_FALLING, EDGE_RISING or EDGE_BOTH
+//          debounce time in msec, 0 for none
+//          semaphore to signal
+//          priority of the port interrupt, KERNELPRI to 7, the pins of a
+//          port share it
+// Outputs: 1 if successful, 0 if 4 pins have edge events or no such pin
+int OS_EdgeSema_Init(uint32_t pin, uint32_t edges, uint32_t debounce, int32_t *semaPt, uint32_t priority);
+
+// ******** OS_EdgeEvents_Init ************
+// Set flags in an event group on edges of an input pin, debounced
+// the same way as OS_EdgeSema_Init
+// Inputs:  pin, edges, debounce time as OS_EdgeSema_Init
+//          event group, and the flags to set
+//          priority of the port interrupt, KERNELPRI to 7
+// Outputs: 1 if successful, 0 if 4 pins have edge events or no such pin
+int OS_EdgeEvents_Init(uint32_t pin, uint32_t edges, uint32_t debounce, EventGroupType *groupPt, uint32_t flags, uint32_t priority);
+
 // ******** OS_EdgeTrigger_Init ************
-// Initialize button1, PD6, to signal on a falling edge interrupt
+// Initialize button1, PD6, to signal on a falling edge interrupt,
+// debounced for 10 msec
 // Inputs:  semaphore to signal
-//          priority
+//          priority, KERNELPRI to 7, higher ones are lowered to KERNELPRI
 // Outputs: none
 void OS_EdgeTrigger_Init(int32_t *semaPt, uint8_t priority);
 
 // ******** OS_EdgeTrigger_Restart ************
-// restart button1 to signal on a falling edge interrupt
-// rearm interrupt
+// Nothing to do, the kernel arms PD6 again after the debounce time;
+// kept for programs that call it after each edge
 // Inputs:  none
 // Outputs: none
 void OS_EdgeTrigger_Restart(void);
@@ -13,33 +13,71 @@
         PRESERVE8
 
         EXTERN  RunPt            ; currently running thread
+        EXTERN  KernelMask       ; BASEPRI of kernel critical sections
         EXPORT  StartOS
-        EXPORT  SysTick_Handler
+        EXPORT  ContextSwitch
+        EXPORT  SetBasePri
         IMPORT  Scheduler
         EXPORT  PendSV_Handler
 
-SysTick_Handler                ; 1) Saves R0-R3,R12,LR,PC,PSR
-    CPSID   I                  ; 2) Prevent interrupt during switch
-    ;YOU IMPLEMENT THIS (same as Lab 3)
-	PUSH	{R4-R11}			; 3)
-	LDR		R0, =RunPt			;
-	LDR		R1, [R0]			; 4)
-	STR		SP, [R1]			; 5)
-	PUSH	{R0,LR}
-	BL 		Scheduler
-	POP		{R0,LR}
-	LDR		R1, [R0]			; 6) R1 = RunPt, new thread
-    LDR     SP, [R1]           ; 7) new thread SP; SP = RunPt->sp;
-    POP     {R4-R11}           ; 8) restore regs r4-11
-    CPSIE   I                  ; 9) tasks run with interrupts enabled
+; All thread switches are done here, at the lowest priority, so they never
+; delay another interrupt.  SysTick, OS_Suspend, OS_Kill and the signal
+; paths only trigger PendSV.  Bit 4 of EXC_RETURN is 0 if the thread used
+; the FPU; only then are S16-S31 saved, the hardware saved S0-S15.
+; Each stack holds, from the top: R0-R3,R12,LR,PC,PSR (FPU state),
+; S16-S31 (FPU threads only), LR (EXC_RETURN), R12 (pad to 8 bytes), R11-R4
+PendSV_Handler                 ; 1) Saves R0-R3,R12,LR,PC,PSR, S0-S15,FPSCR if used
+    TST     LR, #0x10          ; 2) did this thread use the FPU?
+    IT      EQ
+    VPUSHEQ {S16-S31}          ;    yes, save the rest of the FPU registers
+    PUSH    {R4-R12,LR}        ; 3) Save remaining regs r4-11 and EXC_RETURN
+    LDR     R0, =RunPt         ; 4) R0=pointer to RunPt, old thread
+    LDR     R1, [R0]           ;    R1 = RunPt
+    STR     SP, [R1]           ; 5) Save SP into TCB
+    LDR     R0, =KernelMask    ; 6) Scheduler changes the ready lists, mask the
+    LDR     R0, [R0]           ;    interrupts that call the OS, not those above
+    MSR     BASEPRI, R0
+    BL      Scheduler          ;    RunPt = next thread to run
+    MOV     R0, #0
+    MSR     BASEPRI, R0
+    LDR     R0, =RunPt
+    LDR     R1, [R0]           ; 7) R1 = RunPt, new thread
+    LDR     SP, [R1]           ;    new thread SP; SP = RunPt->sp;
+    POP     {R4-R12,LR}        ; 8) restore regs r4-11 and EXC_RETURN
+    TST     LR, #0x10          ; 9) did the new thread use the FPU?
+    IT      EQ
+    VPOPEQ  {S16-S31}          ;    yes, restore the rest of the FPU registers
     BX      LR                 ; 10) restore R0-R3,R12,LR,PC,PSR
 
+; ********ContextSwitch************
+; Trigger PendSV to switch threads as soon as interrupts are enabled
+; Inputs: none
+; Outputs: none
+ContextSwitch
+    LDR     R0, =0xE000ED04    ; Interrupt control state register
+    LDR     R1, =0x10000000
+    STR     R1, [R0]           ; trigger PendSV
+    BX      LR
+
+; ********SetBasePri************
+; Set BASEPRI, interrupts of that priority (in bits 7-5) and lower are held
+; pending, 0 holds none; the I bit is not changed
+; Inputs: R0 new BASEPRI
+; Outputs: R0 BASEPRI before
+SetBasePri
+    MRS     R1, BASEPRI
+    MSR     BASEPRI, R0
+    ISB                        ; a pending interrupt it unmasks is taken here
+    MOV     R0, R1
+    BX      LR
+
 StartOS
     ;YOU IMPLEMENT THIS (same as Lab 3)
 	LDR     R0, =RunPt         ; currently running thread
     LDR     R2, [R0]           ; R2 = value of RunPt
     LDR     SP, [R2]           ; new thread SP; SP = RunPt->stackPointer;
     POP     {R4-R11}           ; restore regs r4-11
+    ADD     SP,SP,#8           ; discard pad and EXC_RETURN from initial stack
     POP     {R0-R3}            ; restore regs r0-3
     POP     {R12}
     ADD     SP,SP,#4           ; discard LR from initial stack
@@ -49,14 +87,4 @@ StartOS
     BX      LR                 ; start first thread
 
     ALIGN
-
-PendSV_Handler
-    LDR     R0, =RunPt         ; run this thread next
-    LDR     R2, [R0]           ; R2 = value of RunPt
-    LDR     SP, [R2]           ; new thread SP; SP = RunPt->stackPointer;
-    POP     {R4-R11}           ; restore regs r4-11
-    LDR     LR,=0xFFFFFFF9
-    BX      LR                 ; start next thread
-	
-    ALIGN
     END